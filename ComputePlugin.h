@@ -0,0 +1,75 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+/**
+ * C interface of compute plugins, see ComputeRegistry::load_plugin.
+ * Plugin includes only this header and does not link against libPerspective,
+ * all data crossing library boundary are plain C types.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** incremented after every incompatible change of this header */
+#define LIBPERSPECTIVE_PLUGIN_API_VERSION 1
+
+/** name of function of type ComputePluginEntry exported by plugin */
+#define LIBPERSPECTIVE_PLUGIN_ENTRY_NAME "libperspective_register_compute_kernels"
+
+/** direction of vanishing point */
+typedef struct ComputePluginDirection {
+    double x;
+    double y;
+    double z;
+    double w;
+} ComputePluginDirection;
+
+/** directions of source vanishing points and additional parameters of compute node */
+typedef struct ComputePluginArgs {
+    const ComputePluginDirection * src;
+    unsigned src_count;
+    const double * params;
+    unsigned params_count;
+} ComputePluginArgs;
+
+/** compute direction of destination vanishing point, \p dst holds its current direction */
+typedef void (*ComputePluginFunction)(const ComputePluginArgs * args, ComputePluginDirection * dst);
+
+/** description of compute function, \p name is copied by registry */
+typedef struct ComputePluginKernel {
+    const char * name;
+    /** accepted number of source nodes */
+    unsigned min_sources;
+    unsigned max_sources;
+    ComputePluginFunction compute;
+} ComputePluginKernel;
+
+/** register \p kernel, returns 0 on success, error is logged by registry */
+typedef int (*ComputePluginRegister)(void * context, const ComputePluginKernel * kernel);
+
+/**
+ * plugin entry point, calls \p register_kernel with \p context for every compute function,
+ * returns 0 on success, plugin built for other \p api_version should fail
+ */
+typedef int (*ComputePluginEntry)(unsigned api_version, void * context, ComputePluginRegister register_kernel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+
+#include "ComputeProgram.h"
+#include "Graph.h"
+
+void ComputeProgram::compile(const std::vector<NodeWrapper *> & nodes) {
+    instructions.clear();
+    operands.clear();
+    params.clear();
+    consumers.clear();
+    viewDependencies.clear();
+
+    std::vector<NodeWrapper *> computeNodes;
+    for (auto && node : nodes) {
+        node->_program_index = -1;
+        if (node->is_compute() && node->_compute_kernel != 0) {
+            node->_program_index = computeNodes.size();
+            computeNodes.push_back(node);
+        }
+    }
+
+    // node depends on its sources and on compute spaces containing its sources
+    const unsigned count = computeNodes.size();
+    std::vector<std::vector<unsigned>> dependents(count);
+    std::vector<unsigned> inDegree(count, 0);
+    for (unsigned i = 0; i < count; i++) {
+        for (auto && relation : computeNodes[i]->get_relations_of_type(NodeRelation::COMPUTE_SRC)) {
+            for (NodeWrapper * src = relation.node; src != nullptr; src = src->get_parent()) {
+                int producer = src->_program_index;
+                if (producer >= 0 && static_cast<unsigned>(producer) != i) {
+                    dependents[producer].push_back(i);
+                    inDegree[i]++;
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned> order;
+    std::vector<unsigned> level(count, 0);
+    order.reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+        if (inDegree[i] == 0) {
+            order.push_back(i);
+        }
+    }
+    unsigned maxLevel = 0;
+    for (unsigned head = 0; head < order.size(); head++) {
+        unsigned current = order[head];
+        maxLevel = std::max(maxLevel, level[current]);
+        for (auto && dependent : dependents[current]) {
+            level[dependent] = std::max(level[dependent], level[current] + 1);
+            if (--inDegree[dependent] == 0) {
+                order.push_back(dependent);
+            }
+        }
+    }
+    if (order.size() != count) {
+        // cycle in compute graph, remaining nodes are computed in load order
+        for (unsigned i = 0; i < count; i++) {
+            if (inDegree[i] != 0) {
+                level[i] = maxLevel + 1;
+                order.push_back(i);
+            }
+        }
+    }
+    // nodes on the same level are independent, group them by compute function
+    std::stable_sort(order.begin(), order.end(), [&level, &computeNodes](unsigned a, unsigned b) {
+        if (level[a] != level[b]) {
+            return level[a] < level[b];
+        }
+        return computeNodes[a]->_compute_kernel < computeNodes[b]->_compute_kernel;
+    });
+
+    groups.clear();
+    instructionGroup.resize(count);
+    unsigned maxGroupSize = 0;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned current = order[i];
+        ComputeKernelId kernelId = computeNodes[current]->_compute_kernel;
+        if (groups.empty() || groups.back().kernel_id != kernelId || level[order[groups.back().begin]] != level[current]) {
+            groups.push_back(Group{
+                .begin = i,
+                .end = i,
+                .kernel_id = kernelId,
+            });
+        }
+        groups.back().end = i + 1;
+        instructionGroup[i] = groups.size() - 1;
+        maxGroupSize = std::max(maxGroupSize, groups.back().end - groups.back().begin);
+    }
+    batch.reserve(maxGroupSize);
+    unbatched.reserve(maxGroupSize);
+    batchSrc0.resize(maxGroupSize);
+    batchSrc1.resize(maxGroupSize);
+    batchDst.resize(maxGroupSize);
+    batchParams.resize(maxGroupSize);
+
+    std::vector<unsigned> position(count);
+    for (unsigned i = 0; i < count; i++) {
+        position[order[i]] = i;
+    }
+
+    const ComputeRegistry & registry = ComputeRegistry::instance();
+    instructions.reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+        NodeWrapper * node = computeNodes[order[i]];
+        node->_program_index = i;
+
+        Instruction instruction;
+        instruction.kernel_id = node->_compute_kernel;
+        instruction.dst = node;
+
+        instruction.src_begin = operands.size();
+        for (auto && relation : node->get_relations_of_type(NodeRelation::COMPUTE_SRC)) {
+            operands.push_back(relation.node);
+        }
+        instruction.src_count = operands.size() - instruction.src_begin;
+
+        const ComputeKernel & kernel = registry.get(instruction.kernel_id);
+        bool arityOk = instruction.src_count >= kernel.min_sources && instruction.src_count <= kernel.max_sources;
+        instruction.kernel = instruction.src_count && arityOk ? &kernel : nullptr;
+        if (instruction.src_count && !arityOk) {
+            LogErr("compute node ", node->uid, " has ", instruction.src_count, " sources, '", kernel.name,
+                   "' accepts ", kernel.min_sources, "-", kernel.max_sources, ", node is not computed");
+        }
+
+        if (instruction.kernel && instruction.kernel->reads_positions) {
+            const unsigned first = viewDependencies.size();
+            auto addView = [this, first, i](const NodeWrapper * view) {
+                for (unsigned j = first; j < viewDependencies.size(); j++) {
+                    if (viewDependencies[j].view == view) {
+                        return;
+                    }
+                }
+                if (view) {
+                    viewDependencies.push_back(ViewDependency{view, i});
+                }
+            };
+            addView(node->get_view());
+            for (unsigned j = instruction.src_begin; j < operands.size(); j++) {
+                addView(operands[j]->get_view());
+            }
+        }
+
+        instruction.params_begin = params.size();
+        params.insert(params.end(), node->_compute_additional_params.begin(), node->_compute_additional_params.end());
+        instruction.params_count = params.size() - instruction.params_begin;
+
+        instruction.consumers_begin = consumers.size();
+        for (auto && dependent : dependents[order[i]]) {
+            if (position[dependent] > i) {
+                consumers.push_back(position[dependent]);
+            }
+        }
+        std::sort(consumers.begin() + instruction.consumers_begin, consumers.end());
+        consumers.erase(std::unique(consumers.begin() + instruction.consumers_begin, consumers.end()), consumers.end());
+        instruction.consumers_count = consumers.size() - instruction.consumers_begin;
+
+        instructions.push_back(instruction);
+    }
+
+    dirty.assign(count, 0);
+    nextDirty = count;
+    valid = true;
+}
+
+void ComputeProgram::mark(const NodeWrapper * node) {
+    int index = node->_program_index;
+    if (index < 0) {
+        return;
+    }
+    dirty[index] = 1;
+    if (static_cast<unsigned>(index) < nextDirty) {
+        nextDirty = index;
+    }
+}
+
+void ComputeProgram::mark_compute_children(const NodeWrapper * node) {
+    for (auto && relation : node->get_relations_of_type(NodeRelation::COMPUTE)) {
+        mark(relation.node);
+    }
+}
+
+void ComputeProgram::mark_view_dependent(const NodeWrapper * view) {
+    for (auto && dependency : viewDependencies) {
+        if (dependency.view == view) {
+            mark(instructions[dependency.instruction].dst);
+        }
+    }
+}
+
+void ComputeProgram::run(GraphBase & graph) {
+    while (nextDirty < instructions.size()) {
+        const Group & group = groups[instructionGroup[nextDirty]];
+        unsigned begin = nextDirty;
+        nextDirty = group.end;
+        batch.clear();
+        unbatched.clear();
+        for (unsigned index = begin; index < group.end; index++) {
+            if (!dirty[index]) {
+                continue;
+            }
+            dirty[index] = 0;
+            if (is_batched(instructions[index])) {
+                batch.push_back(index);
+            } else {
+                unbatched.push_back(index);
+            }
+        }
+        // instructions of group are independent, results are applied in program order
+        execute_unbatched(graph);
+        for (auto && index : unbatched) {
+            finish(graph, index);
+        }
+        if (batch.size()) {
+            execute_batch(*instructions[batch[0]].kernel);
+            for (auto && index : batch) {
+                finish(graph, index);
+            }
+        }
+    }
+}
+
+void ComputeProgram::execute_unbatched(GraphBase & graph) {
+    // kernels read sources through const nodes, outdated positions are projected before
+    for (auto && index : unbatched) {
+        const Instruction & instruction = instructions[index];
+        if (instruction.kernel == nullptr || !instruction.kernel->reads_positions) {
+            continue;
+        }
+        for (unsigned i = 0; i < instruction.src_count; i++) {
+            NodeWrapper * src = operands[instruction.src_begin + i];
+            if (src->is_vanishing_point()) {
+                graph.refresh_position(src);
+            }
+        }
+    }
+    ThreadPool & pool = graph.get_thread_pool();
+    if (unbatched.size() < graph.get_parallel_threshold() || pool.concurrency() < 2) {
+        for (auto && index : unbatched) {
+            execute(instructions[index]);
+        }
+        return;
+    }
+    // chunks shared with clone are copied before instructions write to them, only chunks of destinations
+    PointTable & pointTable = graph.get_point_table();
+    for (auto && index : unbatched) {
+        const NodeWrapper * dst = instructions[index].dst;
+        if (dst->is_vanishing_point()) {
+            pointTable.detach(dst->_slot);
+        }
+    }
+    pool.parallel_for(unbatched.size(), [this](unsigned i) {
+        execute(instructions[unbatched[i]]);
+    });
+}
+
+bool ComputeProgram::is_batched(const Instruction & instruction) {
+    const ComputeKernel * kernel = instruction.kernel;
+    if (kernel == nullptr || kernel->batch == nullptr) {
+        return false;
+    }
+    return instruction.src_count >= kernel->batch_min_sources && instruction.src_count <= kernel->batch_max_sources;
+}
+
+void ComputeProgram::execute_batch(const ComputeKernel & kernel) {
+    const unsigned count = batch.size();
+    for (unsigned i = 0; i < count; i++) {
+        const Instruction & instruction = instructions[batch[i]];
+        const NodeWrapper * const * src = operands.data() + instruction.src_begin;
+        batchSrc0.set(i, src[0]->as_vanishingPoint().get_direction());
+        if (instruction.src_count > 1) {
+            batchSrc1.set(i, src[1]->as_vanishingPoint().get_direction());
+        }
+        batchParams[i] = instruction.params_count ? params[instruction.params_begin] : 0;
+    }
+    ComputeBatchArgs args = {
+        .count = count,
+        .src = {&batchSrc0, &batchSrc1},
+        .params = batchParams.data(),
+        .dst = &batchDst,
+    };
+    kernel.batch(args);
+    for (unsigned i = 0; i < count; i++) {
+        NodeWrapper * dst = instructions[batch[i]].dst;
+        if (kernel.batch_output == ComputeOutput::PLANE_NORMAL) {
+            dst->as_plane().set_normal(batchDst.get(i));
+        } else {
+            dst->as_vanishingPoint().set_direction(batchDst.get(i));
+        }
+    }
+}
+
+void ComputeProgram::finish(GraphBase & graph, unsigned index) {
+    const Instruction & instruction = instructions[index];
+    NodeWrapper * node = instruction.dst;
+    if (instruction.kernel != nullptr) {
+        graph.record_change(node);
+        if (node->is_view() || node->is_space()) {
+            groupComputeNodes.clear();
+            graph.update_groups(node, groupComputeNodes);
+            for (auto && computeNode : groupComputeNodes) {
+                mark(computeNode);
+            }
+        } else {
+            NodeWrapper * view = node->get_view();
+            if (view) {
+                view->update_child(node);
+            }
+        }
+    }
+    for (unsigned i = 0; i < instruction.consumers_count; i++) {
+        dirty[consumers[instruction.consumers_begin + i]] = 1;
+    }
+}
+
+void ComputeProgram::execute(const Instruction & instruction) {
+    if (instruction.kernel == nullptr) {
+        return;
+    }
+    ComputeArgs args = {
+        .src = operands.data() + instruction.src_begin,
+        .src_count = instruction.src_count,
+        .params = params.data() + instruction.params_begin,
+        .params_count = instruction.params_count,
+        .kernel = instruction.kernel,
+    };
+    instruction.kernel->compute(instruction.dst, args);
+}
@@ -0,0 +1,120 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <vector>
+#include "ComputeRegistry.h"
+
+class NodeWrapper;
+class GraphBase;
+
+/**
+ * Compute graph compiled into linear list of instructions.
+ * Instructions are sorted topologically, so one pass over dirty instructions
+ * updates whole compute chain. Program is rebuilt only after change of graph structure.
+ * Independent instructions (same dependency level) are grouped by compute function
+ * and executed as batches, or in parallel on thread pool of graph.
+ * Compute functions write only their destination node.
+ */
+class ComputeProgram {
+public:
+    struct Instruction {
+        ComputeKernelId kernel_id;
+        /** nullptr if number of sources does not match kernel */
+        const ComputeKernel * kernel;
+        NodeWrapper * dst;
+        unsigned src_begin;
+        unsigned src_count;
+        unsigned params_begin;
+        unsigned params_count;
+        unsigned consumers_begin;
+        unsigned consumers_count;
+    };
+    /** range of instructions with same dependency level and compute function */
+    struct Group {
+        unsigned begin;
+        unsigned end;
+        ComputeKernelId kernel_id;
+    };
+    /** instruction with compute function reading positions of nodes shown in view */
+    struct ViewDependency {
+        const NodeWrapper * view;
+        unsigned instruction;
+    };
+private:
+    std::vector<Instruction> instructions;
+    std::vector<Group> groups;
+    std::vector<unsigned> instructionGroup;
+    std::vector<NodeWrapper *> operands;
+    std::vector<precission> params;
+    std::vector<unsigned> consumers;
+    std::vector<ViewDependency> viewDependencies;
+    std::vector<char> dirty;
+    unsigned nextDirty = 0;
+    bool valid = false;
+
+    std::vector<unsigned> batch;
+    /** dirty instructions of group without batch kernel */
+    std::vector<unsigned> unbatched;
+    DirectionColumns batchSrc0;
+    DirectionColumns batchSrc1;
+    DirectionColumns batchDst;
+    std::vector<precission> batchParams;
+    std::vector<NodeWrapper *> groupComputeNodes;
+
+    void execute(const Instruction & instruction);
+    /** execute unbatched instructions of one group, in parallel for large groups */
+    void execute_unbatched(GraphBase & graph);
+    void execute_batch(const ComputeKernel & kernel);
+    void finish(GraphBase & graph, unsigned index);
+public:
+    /** mark program as outdated, it will be compiled again before next use */
+    void invalidate() {
+        valid = false;
+    }
+
+    bool is_valid() const {
+        return valid;
+    }
+
+    /** build instruction list from compute nodes in \p nodes */
+    void compile(const std::vector<NodeWrapper *> & nodes);
+
+    /** schedule computation of \p node, ignored for not compute nodes */
+    void mark(const NodeWrapper * node);
+
+    /** schedule computation of all compute nodes using \p node as source */
+    void mark_compute_children(const NodeWrapper * node);
+
+    /** schedule computation of compute nodes reading positions in \p view, see ComputeKernel::reads_positions */
+    void mark_view_dependent(const NodeWrapper * view);
+
+    /** execute all scheduled instructions and instructions depending on them */
+    void run(GraphBase & graph);
+
+    const std::vector<Instruction> & get_instructions() const {
+        return instructions;
+    }
+
+    const std::vector<Group> & get_groups() const {
+        return groups;
+    }
+
+    /** true if compute function has batch kernel for number of sources of \p instruction */
+    static bool is_batched(const Instruction & instruction);
+};
@@ -0,0 +1,282 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <dlfcn.h>
+#include <stdexcept>
+
+#include "ComputeRegistry.h"
+#include "Graph.h"
+
+namespace {
+    /** batch version of NodeWrapper::compute_mirrored_points */
+    void mirrored_points_kernel(const ComputeBatchArgs & args) {
+        const unsigned count = args.count;
+        const DirectionColumns & src = *args.src[0];
+        DirectionColumns & dst = *args.dst;
+        const precission * sx = src.x.data();
+        const precission * sy = src.y.data();
+        const precission * sz = src.z.data();
+        const precission * sw = src.w.data();
+        precission * dx = dst.x.data();
+        precission * dy = dst.y.data();
+        precission * dz = dst.z.data();
+        precission * dw = dst.w.data();
+        for (unsigned i = 0; i < count; i++) {
+            precission invLength = 1.0 / std::sqrt(sx[i] * sx[i] + sy[i] * sy[i] + sz[i] * sz[i]);
+            dx[i] = sx[i] * invLength;
+            dy[i] = -sy[i] * invLength;
+            dz[i] = sz[i] * invLength;
+            dw[i] = sw[i];
+        }
+    }
+
+    /** batch version of NodeWrapper::compute_measure_points */
+    void measure_points_kernel(const ComputeBatchArgs & args) {
+        const unsigned count = args.count;
+        const precission * base = args.params;
+        const DirectionColumns & src = *args.src[0];
+        DirectionColumns & dst = *args.dst;
+        const precission * sx = src.x.data();
+        const precission * sy = src.y.data();
+        const precission * sz = src.z.data();
+        const precission * sw = src.w.data();
+        precission * dx = dst.x.data();
+        precission * dy = dst.y.data();
+        precission * dz = dst.z.data();
+        precission * dw = dst.w.data();
+        for (unsigned i = 0; i < count; i++) {
+            precission invLength = 1.0 / std::sqrt(sx[i] * sx[i] + sy[i] * sy[i] + sz[i] * sz[i]);
+            precission x = sx[i] * invLength - base[i];
+            precission y = sy[i] * invLength;
+            precission z = sz[i] * invLength;
+            precission length = std::sqrt(x * x + y * y + z * z);
+            bool degenerated = length < 0.000001;
+            precission invDstLength = degenerated ? 1.0 : 1.0 / length;
+            dx[i] = degenerated ? 0 : x * invDstLength;
+            dy[i] = degenerated ? 0 : y * invDstLength;
+            dz[i] = degenerated ? 1 : z * invDstLength;
+            dw[i] = degenerated ? 0 : sw[i];
+        }
+    }
+
+    /** normalized cross product, batch version of NodeWrapper::compute_cross_product */
+    void cross_product_kernel(const ComputeBatchArgs & args) {
+        const unsigned count = args.count;
+        const DirectionColumns & a = *args.src[0];
+        const DirectionColumns & b = *args.src[1];
+        DirectionColumns & dst = *args.dst;
+        const precission * ax = a.x.data();
+        const precission * ay = a.y.data();
+        const precission * az = a.z.data();
+        const precission * bx = b.x.data();
+        const precission * by = b.y.data();
+        const precission * bz = b.z.data();
+        precission * dx = dst.x.data();
+        precission * dy = dst.y.data();
+        precission * dz = dst.z.data();
+        precission * dw = dst.w.data();
+        for (unsigned i = 0; i < count; i++) {
+            precission x = ay[i] * bz[i] - az[i] * by[i];
+            precission y = - ax[i] * bz[i] + az[i] * bx[i];
+            precission z = ax[i] * by[i] - ay[i] * bx[i];
+            precission invLength = 1.0 / std::sqrt(x * x + y * y + z * z);
+            dx[i] = x * invLength;
+            dy[i] = y * invLength;
+            dz[i] = z * invLength;
+            dw[i] = 0;
+        }
+    }
+
+    ComputeKernel kernel(const char * name, ComputeFunction compute, unsigned minSources, unsigned maxSources = UINT_MAX) {
+        ComputeKernel result;
+        result.name = name;
+        result.compute = compute;
+        result.min_sources = minSources;
+        result.max_sources = maxSources;
+        return result;
+    }
+
+    /** compute function of plugin kernels, converts nodes to plain directions of ComputePlugin.h */
+    void plugin_kernel(NodeWrapper * dst, const ComputeArgs & args) {
+        // reused by every kernel call of thread, no allocation after first call
+        thread_local std::vector<ComputePluginDirection> src;
+        src.resize(args.src_count);
+        for (unsigned i = 0; i < args.src_count; i++) {
+            Quaternion direction = args.src[i]->as_vanishingPoint().get_direction();
+            src[i] = ComputePluginDirection{direction.x, direction.y, direction.z, direction.w};
+        }
+        ComputePluginArgs pluginArgs = {
+            .src = src.data(),
+            .src_count = args.src_count,
+            .params = args.params,
+            .params_count = args.params_count,
+        };
+        VanishingPoint & vp = dst->as_vanishingPoint();
+        Quaternion direction = vp.get_direction();
+        ComputePluginDirection result = {direction.x, direction.y, direction.z, direction.w};
+        args.kernel->plugin(&pluginArgs, &result);
+        vp.set_direction(Quaternion(result.x, result.y, result.z, result.w));
+    }
+
+    /** ComputePluginRegister passed to plugins, \p context is registry, exceptions do not cross plugin boundary */
+    int register_plugin_kernel(void * context, const ComputePluginKernel * pluginKernel) {
+        try {
+            if (pluginKernel == nullptr || pluginKernel->name == nullptr || pluginKernel->compute == nullptr) {
+                throw std::runtime_error("incomplete compute function of plugin");
+            }
+            ComputeKernel kernel;
+            kernel.name = pluginKernel->name;
+            kernel.min_sources = pluginKernel->min_sources;
+            kernel.max_sources = pluginKernel->max_sources;
+            kernel.compute = plugin_kernel;
+            kernel.plugin = pluginKernel->compute;
+            static_cast<ComputeRegistry *>(context)->register_kernel(kernel);
+            return 0;
+        } catch (const std::exception & e) {
+            LogErr("compute plugin: ", e.what());
+            return 1;
+        }
+    }
+
+    ComputeKernel reading_positions(ComputeKernel kernel) {
+        kernel.reads_positions = true;
+        return kernel;
+    }
+
+    ComputeKernel with_batch(ComputeKernel kernel, ComputeBatchFunction batch, unsigned minSources, unsigned maxSources, ComputeOutput output = ComputeOutput::DIRECTION) {
+        kernel.batch = batch;
+        kernel.batch_min_sources = minSources;
+        kernel.batch_max_sources = maxSources;
+        kernel.batch_output = output;
+        return kernel;
+    }
+}
+
+ComputeRegistry::ComputeRegistry() : kernelCount(0) {
+    for (auto && chunk : chunks) {
+        chunk = nullptr;
+    }
+    // id 0 - no compute function
+    append_kernel(ComputeKernel());
+    register_builtin_kernels();
+}
+
+void ComputeRegistry::register_builtin_kernels() {
+    register_kernel(with_batch(kernel("plane", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_plane(args);
+    }, 1), cross_product_kernel, 2, 2, ComputeOutput::PLANE_NORMAL));
+    register_kernel(with_batch(kernel("compute_mirrored_points", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_mirrored_points(args);
+    }, 1), mirrored_points_kernel, 1, UINT_MAX));
+    register_kernel(with_batch(kernel("compute_measure_points", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_measure_points(args);
+    }, 1), measure_points_kernel, 1, UINT_MAX));
+    register_kernel(kernel("compute_measure_points_2", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_measure_points_2(args);
+    }, 2));
+    register_kernel(with_batch(kernel("cross_product", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_cross_product(args);
+    }, 2, 2), cross_product_kernel, 2, 2));
+    register_kernel(reading_positions(kernel("2d_direction", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_2d_direction(args);
+    }, 2, 2)));
+    register_kernel(reading_positions(kernel("2d_direction_90", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_2d_direction_90(args);
+    }, 2, 2)));
+    register_kernel(kernel("horizon_1", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_horizon_1(args);
+    }, 1));
+    register_kernel(reading_positions(kernel("space_2p_rect", [](NodeWrapper * dst, const ComputeArgs & args) {
+        dst->compute_space_2p_rect(args);
+    }, 3)));
+}
+
+ComputeRegistry & ComputeRegistry::instance() {
+    static ComputeRegistry registry;
+    return registry;
+}
+
+ComputeKernelId ComputeRegistry::register_kernel(const ComputeKernel & kernel) {
+    if (kernel.compute == nullptr) {
+        throw std::runtime_error("compute function '" + kernel.name + "' without implementation");
+    }
+    if (kernel.min_sources > kernel.max_sources) {
+        throw std::runtime_error("compute function '" + kernel.name + "' - bad number of sources");
+    }
+    if (kernel.batch && (kernel.batch_min_sources < 1 || kernel.batch_max_sources < kernel.batch_min_sources)) {
+        throw std::runtime_error("compute function '" + kernel.name + "' - bad number of batch sources");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ids.count(kernel.name)) {
+        throw std::runtime_error("compute function '" + kernel.name + "' already registered");
+    }
+    if (kernelCount > UINT16_MAX) {
+        throw std::runtime_error("too many compute functions");
+    }
+    ComputeKernelId id = append_kernel(kernel);
+    ids[kernel.name] = id;
+    return id;
+}
+
+ComputeKernelId ComputeRegistry::append_kernel(const ComputeKernel & kernel) {
+    const unsigned id = kernelCount.load(std::memory_order_relaxed);
+    std::atomic<ComputeKernel *> & chunk = chunks[id >> CHUNK_BITS];
+    if (chunk.load(std::memory_order_relaxed) == nullptr) {
+        chunkStorage.emplace_back(new ComputeKernel[CHUNK_SIZE]);
+        chunk.store(chunkStorage.back().get(), std::memory_order_release);
+    }
+    chunk.load(std::memory_order_relaxed)[id & (CHUNK_SIZE - 1)] = kernel;
+    kernelCount.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+ComputeKernelId ComputeRegistry::find(const std::string & name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it == ids.end()) {
+        throw std::runtime_error("unknown compute function");
+    }
+    return it->second;
+}
+
+const ComputeKernel & ComputeRegistry::get(ComputeKernelId id) const {
+    if (id >= kernelCount.load(std::memory_order_acquire)) {
+        throw std::runtime_error("unknown compute function id");
+    }
+    return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+}
+
+void ComputeRegistry::load_plugin(const std::string & path) {
+    void * handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        throw std::runtime_error("can't load compute plugin: " + std::string(dlerror()));
+    }
+    auto entry = reinterpret_cast<ComputePluginEntry>(dlsym(handle, LIBPERSPECTIVE_PLUGIN_ENTRY_NAME));
+    if (entry == nullptr) {
+        dlclose(handle);
+        throw std::runtime_error("compute plugin without entry point: " + path);
+    }
+    // kernels registered before failure stay registered, library stays loaded for them
+    int result = entry(LIBPERSPECTIVE_PLUGIN_API_VERSION, this, register_plugin_kernel);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        plugins.push_back(handle);
+    }
+    if (result != 0) {
+        throw std::runtime_error("compute plugin failed to register its functions: " + path);
+    }
+}
@@ -0,0 +1,154 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ComputePlugin.h"
+#include "Quaternion.h"
+
+class NodeWrapper;
+struct ComputeKernel;
+
+/** Arguments of compute function, views on arrays stored in ComputeProgram */
+struct ComputeArgs {
+    /** read only, writes would copy point table chunks shared with cloned graph */
+    const NodeWrapper * const * src;
+    unsigned src_count;
+    const precission * params;
+    unsigned params_count;
+    /** executed kernel, nullptr if compute function is called directly */
+    const ComputeKernel * kernel;
+};
+
+/** Directions stored as structure of arrays, used by batch compute kernels */
+struct DirectionColumns {
+    std::vector<precission> x;
+    std::vector<precission> y;
+    std::vector<precission> z;
+    std::vector<precission> w;
+
+    void resize(size_t size) {
+        x.resize(size);
+        y.resize(size);
+        z.resize(size);
+        w.resize(size);
+    }
+    Quaternion get(size_t i) const {
+        return Quaternion(x[i], y[i], z[i], w[i]);
+    }
+    void set(size_t i, const Quaternion & q) {
+        x[i] = q.x;
+        y[i] = q.y;
+        z[i] = q.z;
+        w[i] = q.w;
+    }
+};
+
+/**
+ * Arguments of batch compute function.
+ * src[i] holds directions of i-th source of every node in batch,
+ * params holds first additional parameter of every node.
+ */
+struct ComputeBatchArgs {
+    unsigned count;
+    const DirectionColumns * src[2];
+    const precission * params;
+    DirectionColumns * dst;
+};
+
+/** Interned compute function name, 0 is reserved for "no function" */
+using ComputeKernelId = uint16_t;
+
+using ComputeFunction = void (*)(NodeWrapper * dst, const ComputeArgs & args);
+using ComputeBatchFunction = void (*)(const ComputeBatchArgs & args);
+
+/** Value written by batch compute function */
+enum class ComputeOutput : uint8_t {
+    DIRECTION = 0,
+    PLANE_NORMAL = 1,
+};
+
+/** Description of compute function */
+struct ComputeKernel {
+    std::string name;
+    /** accepted number of source nodes, node with other number of sources is not computed and error is logged */
+    unsigned min_sources = 1;
+    unsigned max_sources = UINT_MAX;
+    ComputeFunction compute = nullptr;
+    /** optional batch version of compute, used for nodes with batch_min_sources..batch_max_sources sources */
+    ComputeBatchFunction batch = nullptr;
+    unsigned batch_min_sources = 1;
+    unsigned batch_max_sources = 2;
+    ComputeOutput batch_output = ComputeOutput::DIRECTION;
+    /** compute reads canvas positions of nodes, not only directions, node is recomputed after change of view */
+    bool reads_positions = false;
+    /** function of plugin called by compute, nullptr for native kernels */
+    ComputePluginFunction plugin = nullptr;
+};
+
+/**
+ * Registry of compute functions. Names are resolved to ids when graph is loaded,
+ * compute programs use only ids and kernels.
+ * Builtin functions are always registered, more can be added from native plugins.
+ */
+class ComputeRegistry {
+private:
+    static constexpr unsigned CHUNK_BITS = 8;
+    static constexpr unsigned CHUNK_SIZE = 1 << CHUNK_BITS;
+    /** kernels in chunks which never move, get reads them without lock */
+    std::atomic<ComputeKernel *> chunks[(UINT16_MAX + 1) / CHUNK_SIZE];
+    std::vector<std::unique_ptr<ComputeKernel[]>> chunkStorage;
+    /** published after kernel is stored */
+    std::atomic<unsigned> kernelCount;
+    std::map<std::string, ComputeKernelId> ids;
+    std::vector<void *> plugins;
+    /** serializes registration, find and plugin loading */
+    mutable std::mutex mutex;
+
+    ComputeRegistry();
+    void register_builtin_kernels();
+    /** store \p kernel under next id, mutex must be locked */
+    ComputeKernelId append_kernel(const ComputeKernel & kernel);
+public:
+    ComputeRegistry(const ComputeRegistry &) = delete;
+    ComputeRegistry & operator=(const ComputeRegistry &) = delete;
+
+    static ComputeRegistry & instance();
+
+    /** add new compute function, name must be unique */
+    ComputeKernelId register_kernel(const ComputeKernel & kernel);
+
+    /** return id of compute function, throws for unknown name */
+    ComputeKernelId find(const std::string & name) const;
+
+    /** returned reference stays valid for whole program life, lock free */
+    const ComputeKernel & get(ComputeKernelId id) const;
+
+    /**
+     * load shared library with compute functions, library must export C function
+     * LIBPERSPECTIVE_PLUGIN_ENTRY_NAME of type ComputePluginEntry, see ComputePlugin.h
+     */
+    void load_plugin(const std::string & path);
+};
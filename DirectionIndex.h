@@ -0,0 +1,178 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "Quaternion.h"
+
+/**
+ * Index of unit direction vectors in uniform 3D grid over [-1, 1]^3.
+ * Euclidean distance of unit vectors grows with angle between them, so nearest neighbours
+ * in grid are angularly closest directions. Entries are identified by small unsigned ids (node slots).
+ */
+class DirectionIndex {
+public:
+    enum : unsigned {
+        RESOLUTION = 8,
+    };
+    struct Neighbour {
+        /** Euclidean distance between normalized directions */
+        precission distance;
+        unsigned id;
+        bool operator<(const Neighbour & other) const {
+            return distance < other.distance || (distance == other.distance && id < other.id);
+        }
+    };
+private:
+    struct Entry {
+        unsigned id;
+        Quaternion direction;
+    };
+    struct Location {
+        unsigned cell;
+        /** index in cell, -1 if id is not in index */
+        int index;
+    };
+    std::vector<std::vector<Entry>> cells = std::vector<std::vector<Entry>>(RESOLUTION * RESOLUTION * RESOLUTION);
+    /** indexed by id */
+    std::vector<Location> locations;
+    unsigned count = 0;
+
+    static int cell_coord(precission value) {
+        int coord = static_cast<int>(std::floor((value + 1) * RESOLUTION / 2));
+        return std::min(std::max(coord, 0), static_cast<int>(RESOLUTION) - 1);
+    }
+    static unsigned cell_index(int x, int y, int z) {
+        return (x * RESOLUTION + y) * RESOLUTION + z;
+    }
+public:
+    void clear() {
+        for (auto && cell : cells) {
+            cell.clear();
+        }
+        locations.clear();
+        count = 0;
+    }
+
+    unsigned size() const {
+        return count;
+    }
+
+    /** insert or move entry \p id, zero and not finite directions are removed from index */
+    void set(unsigned id, const Quaternion & direction) {
+        const precission len = length(direction);
+        if (!std::isfinite(len) || len == 0) {
+            remove(id);
+            return;
+        }
+        const Quaternion unit = direction * (1 / len);
+        if (id >= locations.size()) {
+            locations.resize(id + 1, Location{0, -1});
+        }
+        const unsigned cell = cell_index(cell_coord(unit.x), cell_coord(unit.y), cell_coord(unit.z));
+        Location & location = locations[id];
+        if (location.index >= 0) {
+            if (location.cell == cell) {
+                cells[cell][location.index].direction = unit;
+                return;
+            }
+            remove(id);
+        }
+        location.cell = cell;
+        location.index = cells[cell].size();
+        cells[cell].push_back(Entry{id, unit});
+        count++;
+    }
+
+    void remove(unsigned id) {
+        if (id >= locations.size() || locations[id].index < 0) {
+            return;
+        }
+        Location & location = locations[id];
+        std::vector<Entry> & entries = cells[location.cell];
+        // last entry of cell takes place of removed one
+        entries[location.index] = entries.back();
+        locations[entries[location.index].id].index = location.index;
+        entries.pop_back();
+        location.index = -1;
+        count--;
+    }
+
+    /**
+     * \p k entries closest to \p direction accepted by \p accept(id), sorted from closest
+     * grid shells around query cell are visited until no unvisited entry can be closer than k-th found one
+     */
+    template<typename Accept> std::vector<Neighbour> nearest(const Quaternion & direction, unsigned k, Accept accept) const {
+        std::vector<Neighbour> result;
+        const precission len = length(direction);
+        if (k == 0 || !std::isfinite(len) || len == 0) {
+            return result;
+        }
+        const Quaternion unit = direction * (1 / len);
+        const int cx = cell_coord(unit.x);
+        const int cy = cell_coord(unit.y);
+        const int cz = cell_coord(unit.z);
+        const precission cellSize = 2.0 / RESOLUTION;
+        const int last = RESOLUTION - 1;
+        // result is max-heap while searching
+        auto visitCell = [&](int x, int y, int z) {
+            for (auto && entry : cells[cell_index(x, y, z)]) {
+                if (!accept(entry.id)) {
+                    continue;
+                }
+                Neighbour candidate = {length(entry.direction - unit), entry.id};
+                if (result.size() < k) {
+                    result.push_back(candidate);
+                    std::push_heap(result.begin(), result.end());
+                } else if (candidate < result.front()) {
+                    std::pop_heap(result.begin(), result.end());
+                    result.back() = candidate;
+                    std::push_heap(result.begin(), result.end());
+                }
+            }
+        };
+        for (int shell = 0; shell <= last; shell++) {
+            for (int x = std::max(cx - shell, 0); x <= std::min(cx + shell, last); x++) {
+                for (int y = std::max(cy - shell, 0); y <= std::min(cy + shell, last); y++) {
+                    if (std::abs(x - cx) == shell || std::abs(y - cy) == shell) {
+                        for (int z = std::max(cz - shell, 0); z <= std::min(cz + shell, last); z++) {
+                            visitCell(x, y, z);
+                        }
+                    } else {
+                        // inside of shell, only two z layers belong to it
+                        if (cz - shell >= 0) {
+                            visitCell(x, y, cz - shell);
+                        }
+                        if (shell > 0 && cz + shell <= last) {
+                            visitCell(x, y, cz + shell);
+                        }
+                    }
+                }
+            }
+            // entries outside of visited shells are further than shell * cellSize
+            if (result.size() == k && result.front().distance <= shell * cellSize) {
+                break;
+            }
+        }
+        std::sort_heap(result.begin(), result.end());
+        return result;
+    }
+};
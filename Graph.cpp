@@ -17,6 +17,7 @@
 */
 #include <atomic>
 #include <iostream>
+#include <cmath>
 #include <stack>
 #include <algorithm>
 #include <set>
@@ -149,7 +150,7 @@ namespace {
         return plane;
     }
 
-    std::shared_ptr<NodeWrapper> base_node_from_python(RawNode & node)    {
+    std::unique_ptr<NodeWrapper> base_node_from_python(RawNode & node)    {
         std::string type = node.type;
         std::string name;
         if (node.name) {
@@ -157,22 +158,22 @@ namespace {
         }
         if (type == "VP") {
             auto element = vp_from_raw_data(node);
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else if ( type == "RectilinearProjection") {
             auto element = rectilinear_from_raw_data(node);
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else if ( type == "CurvilinearPerspective") {
             auto element = curvilinear_from_raw_data(node);
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else if ( type == "Group") {
             auto element = group_from_python();
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else if ( type == "Plane") {
             auto element = plane_from_python();
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else if ( type == "Space") {
             auto element = space_from_python(node);
-            return std::make_shared<NodeWrapper>(element, name);
+            return std::make_unique<NodeWrapper>(element, name);
         } else {
             throw std::runtime_error("unknown perspective element type '" + name + "'");
         }
@@ -198,16 +199,16 @@ namespace {
         }
     }
 
-    std::shared_ptr<NodeWrapper> node_from_raw_data(RawNode & rawNode) {
-        std::shared_ptr<NodeWrapper> node = base_node_from_python(rawNode);
+    std::unique_ptr<NodeWrapper> node_from_raw_data(RawNode & rawNode) {
+        std::unique_ptr<NodeWrapper> node = base_node_from_python(rawNode);
 
         if (rawNode.is_UI) {
             node->set_UI(*rawNode.is_UI);
         }
 
-        node->enabled = rawNode.enabled;
+        node->set_enabled(rawNode.enabled);
         node->parent_enabled = rawNode.parent_enabled;
-        node->locked = rawNode.locked;
+        node->set_locked(rawNode.locked);
         node->parent_locked = rawNode.parent_locked;
 
         if (rawNode.is_compute) {
@@ -248,175 +249,998 @@ namespace {
     }
 }
 
-int NodeWrapper::getNextUID(){
-    static std::atomic<int> uid { 0 };
-    return ++uid;
+void NodeWrapper::update_compute_point_source(GraphBase* graph, std::vector<NodeWrapper*> sources) {
+    clear_compute_sources();
+    for (auto && src : sources) {
+        src->add_relative(this, NodeRelation::COMPUTE);
+        this->add_relative(src, NodeRelation::COMPUTE_SRC);
+    }
+    graph->invalidate_compute_program();
+    compute(graph);
 }
 
-void NodeWrapper::compute(GraphBase* graph) {
-    std::vector<NodeWrapper*> src;
-    for (auto && relation : _relations) {
-        if (relation.relation == NodeRelation::COMPUTE_SRC) {
-            src.push_back(relation.node);
-        }
+void NodeWrapper::set_compute_additional_params(precission param) {
+    _compute_additional_params = {param};
+    if (_graph) {
+        _graph->invalidate_compute_program();
     }
-    if (src.size() == 0) {
-        return;
+}
+
+void NodeWrapper::set_compute_fct_by_name(std::string name) {
+    _compute_kernel = ComputeRegistry::instance().find(name);
+    if (_graph) {
+        _graph->invalidate_compute_program();
     }
-    if (_compute == nullptr) {
-        return;
+}
+
+void NodeWrapper::set_name(const std::string & name) {
+    if (_detached_name) {
+        *_detached_name = name;
+    } else {
+        _name = _graph->get_symbols().intern(name);
     }
-    (this->*_compute)(src, _compute_additional_params);
-    if (is_view() || is_space()) {
-        std::vector<NodeWrapper*> computeNodes = graph->update_groups(this);
-        for (auto && computeNode : computeNodes) {
-            computeNode->compute(graph);
-        }
+}
+
+const std::string & NodeWrapper::get_compute_function_name() const {
+    return ComputeRegistry::instance().get(_compute_kernel).name;
+}
+
+void NodeWrapper::attach_to_graph(GraphBase * graph, unsigned slot) {
+    _name = graph->get_symbols().intern(get_name());
+    _detached_name.reset();
+    if (is_vanishing_point()) {
+        graph->get_point_table()[slot] = as_vanishingPoint();
+        node.node.vanishingPoint.reset();
+    }
+    _graph = graph;
+    _slot = slot;
+}
+
+NodeWrapper::NodeWrapper(const NodeWrapper & other) :
+    node(other.node),
+    _relations(other._relations),
+    _flags(other._flags),
+    _enabled(other._enabled),
+    _locked(other._locked),
+    role(other.role),
+    uid(other.uid),
+    _name(other._name),
+    _children(other._children),
+    _compute_additional_params(other._compute_additional_params),
+    color(other.color),
+    _compute_kernel(other._compute_kernel),
+    _program_index(other._program_index),
+    _update_index(other._update_index),
+    _change_index(other._change_index),
+    _tour_index(other._tour_index),
+    _subtree_size(other._subtree_size),
+    _graph(other._graph),
+    _slot(other._slot),
+    parent_enabled(other.parent_enabled),
+    parent_locked(other.parent_locked) {
+    std::copy(std::begin(other._relation_offsets), std::end(other._relation_offsets), std::begin(_relation_offsets));
+    if (other._detached_name) {
+        _detached_name = std::make_unique<std::string>(*other._detached_name);
+    }
+}
+
+std::unique_ptr<NodeWrapper> NodeWrapper::clone_to(GraphBase * graph) const {
+    std::unique_ptr<NodeWrapper> result(new NodeWrapper(*this));
+    result->_graph = graph;
+    return result;
+}
+
+void NodeWrapper::set_flag(uint32_t flag, bool value) {
+    if (value) {
+        _flags |= flag;
     } else {
-        auto view = get_view();
-        if (view) {
-            view->update_child(this);
-        }
+        _flags &= ~flag;
+    }
+    if (_graph) {
+        _graph->sync_flags(this);
+    }
+}
+
+void NodeWrapper::set_compute(bool compute) {
+    set_flag(NODE_COMPUTE, compute);
+    if (_graph) {
+        _graph->invalidate_compute_program();
+    }
+}
+
+void NodeWrapper::compute(GraphBase* graph) {
+    graph->recompute(this);
+}
+
+void NodeWrapper::toggle() {
+    set_enabled(!_enabled);
+}
+
+void NodeWrapper::lock() {
+    set_locked(!_locked);
+}
+
+void NodeWrapper::set_enabled(bool value) {
+    _enabled = value;
+    if (_graph) {
+        _graph->update_state(this);
+    }
+}
+
+void NodeWrapper::set_locked(bool value) {
+    _locked = value;
+    if (_graph) {
+        _graph->update_state(this);
     }
 }
 
 std::vector<NodeWrapper *> GraphBase::get_points(NodeWrapper* nodeToDraw) {
-    std::stack<NodeWrapper*> nodes;
-    nodes.push(nodeToDraw);
     std::vector<NodeWrapper*> result;
-    while (!nodes.empty()) {
-        NodeWrapper * node = nodes.top();
-        nodes.pop();
+    for (auto && node : get_subtree(nodeToDraw)) {
         if (node->is_point()) {
             result.push_back(node);
         }
-        for (auto && child : node->get_children()) {
-            nodes.push(child);
-        }
     }
     return result;
 }
 
-std::vector<NodeWrapper *> GraphBase::get_all_enabled_points(bool skipLocked){
-    std::stack<NodeWrapper*> nodes;
-    nodes.push(get_root());
-    std::vector<NodeWrapper*> result;
-    while (!nodes.empty()) {
-        NodeWrapper * node = nodes.top();
-        nodes.pop();
-        if (! node->enabled) {
-            continue;
-        }
-        if (node->locked && skipLocked) {
+void GraphBase::collect_points(NodeRange range, bool skipLocked, std::vector<NodeWrapper *> & result) {
+    for (auto it = range.begin(); it != range.end();) {
+        NodeWrapper * node = *it;
+        if (!node->is_enabled() || (node->is_locked() && skipLocked)) {
+            // skip whole subtree
+            it += node->_subtree_size;
             continue;
         }
         if (node->is_point()) {
             result.push_back(node);
         }
-        for (auto && child : node->get_children()) {
-            nodes.push(child);
+        ++it;
+    }
+}
+
+const std::vector<NodeWrapper *> & GraphBase::get_enabled_points(bool skipLocked) {
+    if (!pointCacheValid) {
+        enabledPoints.clear();
+        unlockedPoints.clear();
+        collect_points(get_subtree(get_root()), false, enabledPoints);
+        collect_points(get_subtree(get_root()), true, unlockedPoints);
+        pointCacheValid = true;
+    }
+    return skipLocked ? unlockedPoints : enabledPoints;
+}
+
+void GraphBase::update_cached_points(NodeWrapper * node, bool skipLocked, std::vector<NodeWrapper *> & points) {
+    // points are in pre-order, so points of subtree are contiguous part of list
+    const int first = node->_tour_index;
+    const int last = first + node->_subtree_size;
+    auto before = [](const NodeWrapper * point, int index) {
+        return point->_tour_index < index;
+    };
+    auto begin = std::lower_bound(points.begin(), points.end(), first, before);
+    auto end = std::lower_bound(begin, points.end(), last, before);
+    statePoints.clear();
+    if (node->parent_enabled && !(skipLocked && node->parent_locked)) {
+        collect_points(get_subtree(node), skipLocked, statePoints);
+    }
+    unsigned position = begin - points.begin();
+    points.erase(begin, end);
+    points.insert(points.begin() + position, statePoints.begin(), statePoints.end());
+}
+
+void GraphBase::update_state(NodeWrapper * node) {
+    ChangeScope scope(*this);
+    NodeRange subtree = get_subtree(node);
+    node->update_toggle_from_parent();
+    node->update_lock_from_parent();
+    // parents are placed before their children
+    for (auto it = subtree.begin() + 1; it != subtree.end(); ++it) {
+        (*it)->update_toggle_from_parent();
+        (*it)->update_lock_from_parent();
+    }
+    for (auto && subtreeNode : subtree) {
+        // flag column still holds state from before change
+        if ((tourFlags[subtreeNode->_tour_index] ^ subtreeNode->get_flags()) & NODE_VISIBLE) {
+            record_change(subtreeNode);
+        }
+        sync_flags(subtreeNode);
+    }
+    stateGeneration++;
+    NodeRange all = get_subtree(get_root());
+    if (!pointCacheValid || subtree.begin() < all.begin() || subtree.begin() >= all.end()) {
+        return;
+    }
+    update_cached_points(node, false, enabledPoints);
+    update_cached_points(node, true, unlockedPoints);
+}
+
+std::vector<NodeWrapper *> GraphBase::nodes_where(uint32_t mask, uint32_t value, const NodeWrapper * root) const {
+    NodeRange subtree = get_subtree(root ? root : get_root());
+    const unsigned first = subtree.begin() - tour.data();
+    const unsigned last = first + subtree.size();
+    const uint32_t * flags = tourFlags.data();
+    std::vector<NodeWrapper *> result;
+    for (unsigned i = first; i < last; i++) {
+        if ((flags[i] & mask) == value) {
+            result.push_back(tour[i]);
         }
     }
     return result;
 }
 
 std::vector<NodeWrapper *> GraphBase::get_all_nodes(NodeWrapper* parent){
-    std::vector<NodeWrapper*> result;
-    forEachNode(parent, [&result](NodeWrapper * node, const NodeWrapper * parent){
-        (void) parent;
-        result.push_back(node);
-    });
-    return result;
+    NodeRange subtree = get_subtree(parent);
+    return std::vector<NodeWrapper *>(subtree.begin(), subtree.end());
+}
+
+void GraphBase::append_tree_to_tour(NodeWrapper * root) {
+    const unsigned begin = tour.size();
+    std::vector<NodeWrapper *> stack = {root};
+    while (!stack.empty()) {
+        NodeWrapper * node = stack.back();
+        stack.pop_back();
+        node->_tour_index = tour.size();
+        tour.push_back(node);
+        tourFlags.push_back(node->get_flags());
+        const NodeWrapper::ChildList & children = node->get_children();
+        stack.insert(stack.end(), children.rbegin(), children.rend());
+    }
+    // children are placed after their parent
+    for (unsigned i = tour.size(); i-- > begin;) {
+        NodeWrapper * node = tour[i];
+        node->_subtree_size = 1;
+        for (auto && child : node->get_children()) {
+            node->_subtree_size += child->_subtree_size;
+        }
+    }
 }
 
+void GraphBase::rebuild_tour() {
+    // roots are nodes which are not children of other nodes
+    std::vector<char> isChild(nodes.size(), 0);
+    for (auto && node : tour) {
+        for (auto && child : node->get_children()) {
+            isChild[child->_slot] = 1;
+        }
+    }
+    std::vector<NodeWrapper *> roots;
+    for (auto && node : tour) {
+        node->_tour_index = -1;
+        if (!isChild[node->_slot]) {
+            roots.push_back(node);
+        }
+    }
+    tour.clear();
+    tourFlags.clear();
+    for (auto && root : roots) {
+        append_tree_to_tour(root);
+    }
+}
+
+void GraphBase::relations_changed(NodeWrapper * moved) {
+    if (structureEditDepth != 0) {
+        return;
+    }
+    invalidate_compute_program();
+    invalidate_update_order();
+    if (moved == nullptr) {
+        return;
+    }
+    rebuild_tour();
+    invalidate_point_cache();
+    if (moved->_tour_index >= 0) {
+        update_state(moved);
+    }
+}
+
+void GraphBase::reindex_tour(unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; i++) {
+        tour[i]->_tour_index = i;
+        tourFlags[i] = tour[i]->get_flags();
+    }
+}
 
 std::vector<NodeWrapper *> GraphBase::get_logic_children(NodeWrapper* node){
-    std::stack<NodeWrapper*> groups;
-    groups.push(node);
+    build_update_order();
     std::vector<NodeWrapper*> result;
-    while (!groups.empty()) {
-        NodeWrapper* group = groups.top();
-        groups.pop();
-        for (auto && child : group->get_children()) {
-            // TODO add comments
-            if (child->is_UI_only()) {
-                groups.push(child);
+    const UpdateStep & head = updateOrder[node->_update_index];
+    for (unsigned i = node->_update_index + 1; i < head.end;) {
+        const UpdateStep & step = updateOrder[i];
+        if (step.node->is_UI_only()) {
+            // UI only groups are transparent, their children follow them
+            ++i;
+        } else {
+            result.push_back(step.node);
+            i = step.end;
+        }
+    }
+    return result;
+}
+
+void GraphBase::build_update_order() {
+    if (updateOrderValid) {
+        return;
+    }
+    updateOrder.clear();
+    for (auto && node : nodes) {
+        if (node) {
+            node->_update_index = -1;
+        }
+    }
+    // descend only into groups visited by update_groups: tree roots, UI only groups, spaces and views
+    struct Frame {
+        unsigned step;
+        unsigned nextChild;
+    };
+    std::vector<Frame> stack;
+    auto addStep = [this, &stack](NodeWrapper * node, NodeWrapper * space, NodeWrapper * view, bool isRoot) {
+        unsigned index = updateOrder.size();
+        node->_update_index = index;
+        updateOrder.push_back(UpdateStep{
+            .node = node,
+            .space = space,
+            .view = view,
+            .end = index + 1,
+        });
+        if (isRoot || node->is_UI_only() || node->is_space() || node->is_view()) {
+            stack.push_back(Frame{
+                .step = index,
+                .nextChild = 0,
+            });
+        }
+    };
+    for (auto && root : nodes) {
+        if (!root || root->get_parent() != nullptr) {
+            continue;
+        }
+        addStep(root.get(), nullptr, nullptr, true);
+        while (!stack.empty()) {
+            Frame & frame = stack.back();
+            const UpdateStep step = updateOrder[frame.step];
+            const NodeWrapper::ChildList & children = step.node->get_children();
+            if (frame.nextChild == children.size()) {
+                updateOrder[frame.step].end = updateOrder.size();
+                stack.pop_back();
+                continue;
+            }
+            NodeWrapper * child = children[frame.nextChild++];
+            if (step.node->is_space()) {
+                addStep(child, step.node, step.node->get_view(), false);
+            } else if (step.node->is_view()) {
+                addStep(child, nullptr, step.node, false);
             } else {
-                result.push_back(child);
+                addStep(child, step.space, step.view, false);
             }
         }
     }
-    return result;
+    updateOrderValid = true;
 }
 
 std::vector<NodeWrapper *> GraphBase::update_groups(NodeWrapper* group) {
     std::vector<NodeWrapper*> computeNodes;
-    NodeWrapper * view = nullptr;
-    NodeWrapper * space = nullptr;
-    if (group->is_space()) {
-        space = group;
-        view = group->get_view();
-    } else {
-        view = group;
-    }
-    for (auto && child : get_logic_children(group)) {
-        for (auto && toCompute : child->get_compute_children()) {
-            computeNodes.push_back(toCompute);
+    update_groups(group, computeNodes);
+    return computeNodes;
+}
+
+template<typename Record>
+void GraphBase::update_steps(unsigned begin, unsigned end, std::vector<NodeWrapper *> & computeNodes, Record record) {
+    // spaces are updated before their children, views nested in group are skipped
+    for (unsigned i = begin; i < end;) {
+        const UpdateStep & step = updateOrder[i];
+        NodeWrapper * child = step.node;
+        if (child->is_UI_only()) {
+            ++i;
+            continue;
+        }
+        for (auto && relation : child->get_relations_of_type(NodeRelation::COMPUTE)) {
+            computeNodes.push_back(relation.node);
         }
         if (child->is_space()) {
-            if (space) {
-                space->update_subspace(child);
+            record(child);
+            if (step.space) {
+                step.space->update_subspace(child);
             }
-            auto tmpCN = update_groups(child);
-            computeNodes.insert(computeNodes.end(), tmpCN.begin(), tmpCN.end());
-        } else if (child->is_view()) {
-            // pass
-        } else {
-            if (child->is_compute()) {
-                continue;
-            }
-            if (child->is_point() && space) {
-                space->update_child_dir(child);
+            ++i;
+            continue;
+        }
+        i = step.end;
+        if (child->is_view() || child->is_compute()) {
+            continue;
+        }
+        record(child);
+        if (child->is_point() && step.space) {
+            step.space->update_child_dir(child);
+        }
+        step.view->update_child(child);
+    }
+}
+
+void GraphBase::update_groups(NodeWrapper* group, std::vector<NodeWrapper*> & computeNodes) {
+    build_update_order();
+    const unsigned begin = group->_update_index + 1;
+    const unsigned end = updateOrder[group->_update_index].end;
+    ThreadPool & pool = get_thread_pool();
+    if (end - begin < parallelThreshold || pool.concurrency() < 2) {
+        update_steps(begin, end, computeNodes, [this](NodeWrapper * node) {
+            record_change(node);
+        });
+        return;
+    }
+    // chunks shared with clone are copied before tasks write to them, only chunks of points updated by tasks
+    for (unsigned i = begin; i < end;) {
+        const UpdateStep & step = updateOrder[i];
+        NodeWrapper * child = step.node;
+        if (child->is_UI_only() || child->is_space()) {
+            ++i;
+            continue;
+        }
+        i = step.end;
+        if (child->is_vanishing_point() && !child->is_compute()) {
+            pointTable.detach(child->_slot);
+        }
+    }
+    // subtrees of group are independent, UI only groups are transparent
+    std::vector<UpdateTask> tasks;
+    tasks.swap(updateTasks);
+    unsigned taskCount = 0;
+    for (unsigned i = begin; i < end;) {
+        const UpdateStep & step = updateOrder[i];
+        if (step.node->is_UI_only()) {
+            ++i;
+            continue;
+        }
+        if (taskCount == tasks.size()) {
+            tasks.emplace_back();
+        }
+        UpdateTask & task = tasks[taskCount++];
+        task.begin = i;
+        task.end = step.end;
+        task.computeNodes.clear();
+        task.records.clear();
+        i = step.end;
+    }
+    const bool recording = changeDepth != 0;
+    try {
+        pool.parallel_for(taskCount, [this, &tasks, recording](unsigned index) {
+            UpdateTask & task = tasks[index];
+            update_steps(task.begin, task.end, task.computeNodes, [this, &task, recording](NodeWrapper * node) {
+                if (recording && node->_change_index < 0) {
+                    task.records.push_back(make_change_record(node));
+                }
+            });
+        });
+    } catch (...) {
+        tasks.swap(updateTasks);
+        throw;
+    }
+    // merged in traversal order, result is the same as serial update
+    for (unsigned i = 0; i < taskCount; i++) {
+        computeNodes.insert(computeNodes.end(), tasks[i].computeNodes.begin(), tasks[i].computeNodes.end());
+        for (auto && record : tasks[i].records) {
+            add_change_record(record);
+        }
+    }
+    tasks.swap(updateTasks);
+}
+
+ComputeProgram & GraphBase::get_compute_program() {
+    if (!computeProgram.is_valid()) {
+        std::vector<NodeWrapper *> allNodes;
+        allNodes.reserve(nodes.size());
+        for (auto && node : nodes) {
+            if (node) {
+                allNodes.push_back(node.get());
             }
-            view->update_child(child);
         }
+        computeProgram.compile(allNodes);
     }
-    return computeNodes;
+    return computeProgram;
 }
 
 void GraphBase::update(NodeWrapper* node, Complex pos) {
-    std::stack<NodeWrapper*> computeNodes;
+    ChangeScope scope(*this);
+    ComputeProgram & program = get_compute_program();
     NodeWrapper * space = find_parent_space(node);
     NodeWrapper * view = node->get_view();
     if (node->is_key() && space != nullptr) {
+        if (batchDepth && has_pending_space(space, true)) {
+            // key direction or space rotation is outdated
+            update_pending_spaces();
+        }
         Quaternion newDir = view->as_projection()->calc_direction(pos);
-        space->update_space(node->as_vanishingPoint(), newDir);
-        std::vector<NodeWrapper*> tmpComputeNodes = update_groups(space);
-        for (auto && tmp : tmpComputeNodes ) {
-            computeNodes.push(tmp);
+        record_change(space);
+        space->update_space(static_cast<const NodeWrapper *>(node)->as_vanishingPoint(), newDir);
+        if (batchDepth) {
+            pendingSpaces.push_back(space);
+        } else {
+            updateComputeNodes.clear();
+            update_groups(space, updateComputeNodes);
+            for (auto && computeNode : updateComputeNodes) {
+                program.mark(computeNode);
+            }
         }
     } else {
         if (space != nullptr) {
+            if (batchDepth && has_pending_space(space, false)) {
+                update_pending_spaces();
+            }
+            record_change(node);
             view->update_child(node, pos);
             space->as_space().move_child_to_space(node->as_vanishingPoint());
         } else {
+            record_change(node);
             view->update_child(node,pos);
         }
-        for (auto && toCompute : node->get_compute_children()) {
-            computeNodes.push(toCompute);
+        program.mark_compute_children(node);
+    }
+
+    if (!batchDepth) {
+        program.run(*this);
+    }
+}
+
+void GraphBase::begin_batch() {
+    begin_changes();
+    batchDepth++;
+}
+
+void GraphBase::commit() {
+    if (batchDepth == 0) {
+        throw std::runtime_error("commit without begin_batch");
+    }
+    ChangeScope scope(*this, false);
+    if (--batchDepth) {
+        return;
+    }
+    update_pending_spaces();
+    get_compute_program().run(*this);
+}
+
+void GraphBase::abort_batch() {
+    if (batchDepth == 0) {
+        throw std::runtime_error("abort_batch without begin_batch");
+    }
+    ChangeScope scope(*this, false);
+    if (--batchDepth == 0) {
+        pendingSpaces.clear();
+    }
+}
+
+bool GraphBase::has_pending_space(const NodeWrapper * space, bool includeSelf) const {
+    for (auto && pending : pendingSpaces) {
+        if (pending == space) {
+            if (includeSelf) {
+                return true;
+            }
+        } else if (space->_tour_index > pending->_tour_index && space->_tour_index < pending->_tour_index + static_cast<int>(pending->_subtree_size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GraphBase::update_pending_spaces() {
+    // outer spaces first, nested pending spaces are updated together with them
+    std::sort(pendingSpaces.begin(), pendingSpaces.end(), [](const NodeWrapper * a, const NodeWrapper * b) {
+        return a->_tour_index < b->_tour_index;
+    });
+    ComputeProgram & program = get_compute_program();
+    int coveredEnd = -1;
+    for (auto && space : pendingSpaces) {
+        if (space->_tour_index < coveredEnd) {
+            continue;
+        }
+        coveredEnd = space->_tour_index + space->_subtree_size;
+        updateComputeNodes.clear();
+        update_groups(space, updateComputeNodes);
+        for (auto && computeNode : updateComputeNodes) {
+            program.mark(computeNode);
+        }
+    }
+    pendingSpaces.clear();
+}
+
+void GraphBase::begin_changes() {
+    if (changeDepth++) {
+        return;
+    }
+    changes.uids.clear();
+    changes.old_bounds.clear();
+    changes.new_bounds.clear();
+    changes.structure_changed = false;
+}
+
+void GraphBase::record_change(NodeWrapper * node) {
+    if (changeDepth == 0 || node->_change_index >= 0) {
+        return;
+    }
+    add_change_record(make_change_record(node));
+}
+
+GraphBase::ChangeRecord GraphBase::make_change_record(NodeWrapper * node) const {
+    const int tourIndex = node->_tour_index;
+    const bool visible = node->is_vanishing_point() && tourIndex >= 0 && (tourFlags[tourIndex] & NODE_VISIBLE) == NODE_VISIBLE;
+    return ChangeRecord{
+        .node = node,
+        .position = visible ? node->get_position() : Complex(),
+        .visible = visible,
+    };
+}
+
+void GraphBase::add_change_record(const ChangeRecord & record) {
+    NodeWrapper * node = record.node;
+    if (node->_change_index >= 0) {
+        return;
+    }
+    node->_change_index = changeRecords.size();
+    changeRecords.push_back(record);
+    changes.uids.push_back(node->uid);
+}
+
+void GraphBase::finish_changes() {
+    if (--changeDepth) {
+        return;
+    }
+    auto addToBounds = [](std::vector<precission> & bounds, const Complex & position) {
+        const precission x = position.real();
+        const precission y = position.imag();
+        if (!std::isfinite(x) || !std::isfinite(y)) {
+            return;
+        }
+        if (bounds.empty()) {
+            bounds = {x, y, x, y};
+            return;
+        }
+        bounds[0] = std::min(bounds[0], x);
+        bounds[1] = std::min(bounds[1], y);
+        bounds[2] = std::max(bounds[2], x);
+        bounds[3] = std::max(bounds[3], y);
+    };
+    for (auto && record : changeRecords) {
+        if (record.visible) {
+            addToBounds(changes.old_bounds, record.position);
+        }
+        NodeWrapper * node = record.node;
+        if (node == nullptr) {
+            continue;
+        }
+        node->_change_index = -1;
+        if (node->is_vanishing_point() && node->is_enabled() && node->parent_enabled) {
+            addToBounds(changes.new_bounds, node->get_position());
+        }
+        const bool inRootTree = is_in_root_tree(node);
+        if (pointGridValid && node->is_point() && inRootTree) {
+            pointGrid.set(node->_slot, node->get_position());
+        }
+        if (directionIndexValid && node->is_vanishing_point() && inRootTree) {
+            directionIndex.set(node->_slot, static_cast<const NodeWrapper *>(node)->as_vanishingPoint().get_direction());
+        }
+    }
+    changeRecords.clear();
+    if (publishSnapshots) {
+        publish_snapshot();
+    }
+}
+
+/** copy of state of \p view, independent of graph */
+static std::shared_ptr<const Projection> copy_projection(const NodeWrapper * view) {
+    const Projection * projection = view->as_projection();
+    if (view->is_rectilinear()) {
+        return std::make_shared<RectilinearProjection>(static_cast<const RectilinearProjection &>(*projection));
+    }
+    return std::make_shared<CurvilinearPerspective>(static_cast<const CurvilinearPerspective &>(*projection));
+}
+
+void GraphBase::publish_snapshot() {
+    std::shared_ptr<RenderSnapshot> snapshot;
+    // readers can get only published snapshot, so spare one is not shared if its count is 1
+    if (spareSnapshot && spareSnapshot.use_count() == 1) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        snapshot = std::move(spareSnapshot);
+    } else {
+        snapshot = std::make_shared<RenderSnapshot>();
+    }
+    snapshot->generation = publishedSnapshot ? publishedSnapshot->generation + 1 : 0;
+    snapshot->uids.clear();
+    snapshot->positions.clear();
+    snapshot->directions.clear();
+    snapshot->flags.clear();
+    snapshot->views.clear();
+    snapshot->outdated.clear();
+    snapshot->projections.clear();
+    // reprojection is left to readers, publish after view change does not refresh all its points
+    std::vector<const NodeWrapper *> & outdatedViews = snapshotOutdatedViews;
+    outdatedViews.clear();
+    for (auto && node : get_subtree(get_root())) {
+        if (!node->is_vanishing_point()) {
+            continue;
+        }
+        NodeWrapper * view = node->get_view();
+        const VanishingPoint & vp = static_cast<const NodeWrapper *>(node)->as_vanishingPoint();
+        int outdated = -1;
+        if (view && is_position_outdated(node, view)) {
+            outdated = std::find(outdatedViews.begin(), outdatedViews.end(), view) - outdatedViews.begin();
+            if (static_cast<size_t>(outdated) == outdatedViews.size()) {
+                outdatedViews.push_back(view);
+                snapshot->projections.push_back(copy_projection(view));
+            }
+        }
+        snapshot->uids.push_back(node->uid);
+        snapshot->positions.push_back(vp.get_position());
+        snapshot->directions.push_back(vp.get_direction());
+        snapshot->flags.push_back(tourFlags[node->_tour_index]);
+        snapshot->views.push_back(view ? view->uid : -1);
+        snapshot->outdated.push_back(outdated);
+    }
+    snapshot->visualizations = visualizations;
+    std::atomic_store(&renderSnapshot, std::shared_ptr<const RenderSnapshot>(snapshot));
+    spareSnapshot = std::move(publishedSnapshot);
+    publishedSnapshot = std::move(snapshot);
+}
+
+void GraphBase::build_point_grid() {
+    if (pointGridValid) {
+        // only points of views changed lazily are projected again
+        for (auto && view : gridOutdatedViews) {
+            if (!is_in_root_tree(view)) {
+                continue;
+            }
+            for (auto && node : get_subtree(view)) {
+                if (node->is_point() && node->get_view() == view) {
+                    pointGrid.set(node->_slot, node->get_position());
+                }
+            }
+        }
+        gridOutdatedViews.clear();
+        return;
+    }
+    gridOutdatedViews.clear();
+    pointGrid.clear();
+    for (auto && node : get_subtree(get_root())) {
+        if (node->is_point()) {
+            pointGrid.set(node->_slot, node->get_position());
+        }
+    }
+    pointGridValid = true;
+}
+
+void GraphBase::build_direction_index() {
+    if (directionIndexValid) {
+        return;
+    }
+    directionIndex.clear();
+    for (auto && node : get_subtree(get_root())) {
+        if (node->is_vanishing_point()) {
+            directionIndex.set(node->_slot, static_cast<const NodeWrapper *>(node)->as_vanishingPoint().get_direction());
         }
     }
+    directionIndexValid = true;
+}
+
+bool GraphBase::is_pickable(const NodeWrapper * node, bool skipLocked) const {
+    const uint32_t flags = tourFlags[node->_tour_index];
+    if ((flags & NODE_VISIBLE) != NODE_VISIBLE) {
+        return false;
+    }
+    return !skipLocked || !(flags & (NODE_LOCKED | NODE_PARENT_LOCKED));
+}
+
+NodeWrapper * GraphBase::pick(Complex pos, precission radius, bool skipLocked) {
+    build_point_grid();
+    const BBox bbox = {
+        .min_x = pos.real() - radius,
+        .min_y = pos.imag() - radius,
+        .max_x = pos.real() + radius,
+        .max_y = pos.imag() + radius,
+    };
+    NodeWrapper * result = nullptr;
+    precission resultDistance = radius;
+    pointGrid.for_each_in_rect(bbox, [&](const SpatialGrid::Entry & entry) {
+        NodeWrapper * node = nodes[entry.id].get();
+        if (!is_pickable(node, skipLocked)) {
+            return;
+        }
+        const precission distance = std::abs(entry.position - pos);
+        // equal distance: first point in pre-order wins, independent of grid layout
+        if (distance < resultDistance || (distance == resultDistance && (result == nullptr || node->_tour_index < result->_tour_index))) {
+            result = node;
+            resultDistance = distance;
+        }
+    });
+    return result;
+}
+
+void GraphBase::invalidate_view(NodeWrapper * view) {
+    ChangeScope scope(*this);
+    outdate_view_positions(view);
+    outdate_grid_positions(view);
+    recompute_view_dependent(view);
+}
+
+void GraphBase::outdate_view_positions(NodeWrapper * view) {
+    positionGenerations[view->_slot]++;
+    record_change(view);
+    changes.structure_changed = true;
+}
+
+void GraphBase::outdate_grid_positions(NodeWrapper * view) {
+    if (pointGridValid && std::find(gridOutdatedViews.begin(), gridOutdatedViews.end(), view) == gridOutdatedViews.end()) {
+        gridOutdatedViews.push_back(view);
+    }
+}
+
+void GraphBase::recompute_view_dependent(NodeWrapper * view) {
+    // only compute functions reading positions (ComputeKernel::reads_positions) depend on view
+    ComputeProgram & program = get_compute_program();
+    program.mark_view_dependent(view);
+    if (!batchDepth) {
+        program.run(*this);
+    }
+}
 
-    while (!computeNodes.empty()) {
-        NodeWrapper * computeNode = computeNodes.top();
-        computeNodes.pop();
-        computeNode->compute(this);
-        for (auto && toCompute : computeNode->get_compute_children()) {
-            computeNodes.push(toCompute);
+void GraphBase::set_view_transform(NodeWrapper * view, const Complex & center, const Complex & rotation, precission size) {
+    ChangeScope scope(*this);
+    Projection * projection = view->as_projection();
+    const Complex oldCenter = projection->get_center_complex();
+    const Complex oldScale = projection->get_rotation() * projection->get_size();
+    projection->set_all(center, rotation, size);
+    outdate_view_positions(view);
+    if (view->is_rectilinear() && oldScale != Complex(0, 0)) {
+        // pick grid is updated together with moved points
+        transform_view_positions(view, oldCenter, oldScale);
+    } else {
+        outdate_grid_positions(view);
+    }
+    recompute_view_dependent(view);
+}
+
+void GraphBase::transform_view_positions(NodeWrapper * view, const Complex & oldCenter, const Complex & oldScale) {
+    Projection * projection = view->as_projection();
+    const Complex center = projection->get_center_complex();
+    const Complex rotation = projection->get_rotation();
+    const precission size = projection->get_size();
+    // rectilinear position is dir.xy * size / dir.z * rotation + center, change of view is similarity transform
+    const Complex scale = rotation * size / oldScale;
+    const Complex offset = center - oldCenter * scale;
+    const unsigned viewGeneration = positionGenerations[view->_slot];
+    const bool updateGrid = pointGridValid && is_in_root_tree(view);
+    for (auto && node : get_subtree(view)) {
+        if (!node->is_vanishing_point() || node->get_view() != view) {
+            continue;
+        }
+        unsigned & generation = positionGenerations[node->_slot];
+        if (generation != viewGeneration - 1) {
+            // position was already outdated, it is projected on access
+            outdate_grid_positions(view);
+            continue;
+        }
+        generation = viewGeneration;
+        VanishingPoint & vp = node->as_vanishingPoint();
+        if (vp.get_direction().z == 0) {
+            // point at infinity has fixed position
+            projection->update_child(vp);
+        } else {
+            Complex modelPosition = projection->display_to_model(vp.get_position());
+            vp.set_position(projection->model_to_display(modelPosition * scale + offset));
+        }
+        if (updateGrid) {
+            pointGrid.set(node->_slot, vp.get_position());
         }
     }
 }
 
+void GraphBase::link_view(NodeWrapper * view, NodeWrapper * source) {
+    if (!view->is_projection() || !source->is_projection() || view == source) {
+        throw std::runtime_error("link_view needs two different projections");
+    }
+    unlink_view(view);
+    linkedViews.push_back(LinkedView{
+        .view = view,
+        .source = source,
+        .positions = {},
+        .generations = {},
+        .pointGenerations = {},
+    });
+    ChangeScope scope(*this);
+    record_change(view);
+    changes.structure_changed = true;
+}
+
+void GraphBase::unlink_view(NodeWrapper * view) {
+    linkedViews.erase(std::remove_if(linkedViews.begin(), linkedViews.end(), [view](const LinkedView & linked) {
+        return linked.view == view;
+    }), linkedViews.end());
+}
+
+std::vector<NodeWrapper *> GraphBase::get_linked_views(const NodeWrapper * source) const {
+    std::vector<NodeWrapper *> result;
+    for (auto && linked : linkedViews) {
+        if (linked.source == source) {
+            result.push_back(linked.view);
+        }
+    }
+    return result;
+}
+
+GraphBase::LinkedView & GraphBase::get_linked_view(const NodeWrapper * view) {
+    for (auto && linked : linkedViews) {
+        if (linked.view == view) {
+            return linked;
+        }
+    }
+    throw std::runtime_error("view is not linked");
+}
+
+Complex GraphBase::get_position_in_view(NodeWrapper * node, NodeWrapper * view) {
+    NodeWrapper * nodeView = node->get_view();
+    if (view == nodeView) {
+        return node->get_position();
+    }
+    LinkedView & linked = get_linked_view(view);
+    if (linked.source != nodeView) {
+        throw std::runtime_error("node is not shown in view");
+    }
+    const unsigned slot = node->_slot;
+    if (slot >= linked.generations.size()) {
+        linked.generations.resize(nodes.size(), INVALID_GENERATION);
+        linked.pointGenerations.resize(nodes.size());
+        linked.positions.resize(nodes.size());
+    }
+    // direction can be changed by any write to point table, also outside of change journal
+    const unsigned generation = positionGenerations[view->_slot];
+    const unsigned pointGeneration = pointTable.get_generation(slot);
+    if (linked.generations[slot] != generation || linked.pointGenerations[slot] != pointGeneration) {
+        const VanishingPoint & vp = static_cast<const NodeWrapper *>(node)->as_vanishingPoint();
+        linked.positions[slot] = view->as_projection()->calc_pos_from_dir(vp.get_direction());
+        linked.generations[slot] = generation;
+        linked.pointGenerations[slot] = pointGeneration;
+    }
+    return linked.positions[slot];
+}
+
+void GraphBase::refresh_positions(NodeWrapper * root) {
+    NodeRange range = get_subtree(root ? root : get_root());
+    for (auto it = range.begin(); it != range.end();) {
+        NodeWrapper * node = *it;
+        if (!node->is_enabled()) {
+            // skip whole subtree
+            it += node->_subtree_size;
+            continue;
+        }
+        if (node->is_vanishing_point()) {
+            refresh_position(node);
+        }
+        ++it;
+    }
+}
+
+std::vector<NodeWrapper *> GraphBase::nearest_directions(const Quaternion & direction, unsigned k, bool skipLocked) {
+    build_direction_index();
+    auto accept = [this, skipLocked](unsigned slot) {
+        return is_pickable(nodes[slot].get(), skipLocked);
+    };
+    std::vector<NodeWrapper *> result;
+    for (auto && neighbour : directionIndex.nearest(direction, k, accept)) {
+        result.push_back(nodes[neighbour.id].get());
+    }
+    return result;
+}
+
+std::vector<NodeWrapper *> GraphBase::points_in_rect(const BBox & bbox, bool skipLocked) {
+    build_point_grid();
+    std::vector<NodeWrapper *> result;
+    pointGrid.for_each_in_rect(bbox, [&](const SpatialGrid::Entry & entry) {
+        NodeWrapper * node = nodes[entry.id].get();
+        if (is_pickable(node, skipLocked)) {
+            result.push_back(node);
+        }
+    });
+    std::sort(result.begin(), result.end(), [](const NodeWrapper * a, const NodeWrapper * b) {
+        return a->_tour_index < b->_tour_index;
+    });
+    return result;
+}
+
 GraphBase::NewElementData GraphBase::get_group_for_new_element(){
     NodeWrapper * chosen = chosen_point;
     NodeWrapper * group = main_view;
@@ -447,6 +1271,8 @@ GraphBase::NewElementData GraphBase::get_group_for_new_element(){
 
 /** connect sub graph with root in local_rot as child of currently selected element */
 NodeWrapper * GraphBase::connect_sub_graph(NodeWrapper* localRoot){
+    ChangeScope scope(*this);
+    StructureEdit edit(*this);
     auto data = get_group_for_new_element();
 
     if (localRoot->is_point()) {
@@ -462,14 +1288,30 @@ NodeWrapper * GraphBase::connect_sub_graph(NodeWrapper* localRoot){
         }
     }
 
+    // move sub graph tree to the end of group subtree
+    const unsigned from = localRoot->_tour_index;
+    const unsigned count = localRoot->_subtree_size;
+    const unsigned to = data.group->_tour_index + data.group->_subtree_size;
+    auto tourBegin = tour.begin();
+    if (from > to) {
+        std::rotate(tourBegin + to, tourBegin + from, tourBegin + from + count);
+        reindex_tour(to, from + count);
+    } else if (from < to) {
+        std::rotate(tourBegin + from, tourBegin + from + count, tourBegin + to);
+        reindex_tour(from, to);
+    }
+    for (NodeWrapper * ancestor = data.group; ancestor != nullptr; ancestor = ancestor->get_parent()) {
+        ancestor->_subtree_size += count;
+    }
+
     data.group->add_child(localRoot);
     localRoot->add_parent(data.group);
+    invalidate_compute_program();
+    invalidate_update_order();
+    invalidate_point_cache();
+    update_state(localRoot);
 
-    std::stack<NodeWrapper*> nodes;
-    nodes.push(localRoot);
-    while (!nodes.empty()) {
-        NodeWrapper * node = nodes.top();
-        nodes.pop();
+    for (auto && node : get_subtree(localRoot)) {
         if (node->get_view() == nullptr) {
             node->add_view(data.view);
             if (node->is_vanishing_point()) {
@@ -478,9 +1320,6 @@ NodeWrapper * GraphBase::connect_sub_graph(NodeWrapper* localRoot){
         } else if (node->is_vanishing_point()) {
             node->get_view()->update_child(node);
         }
-        for (auto && child : node->get_children()) {
-            nodes.push(child);
-        }
     }
     return localRoot;
 }
@@ -489,63 +1328,67 @@ RawGraph GraphBase::to_raw_data() {
     std::map<int, std::string> tagMap;
     RawGraph result;
     for (auto && tag : tags) {
-        tagMap[tag.second->uid] = tag.first;
+        tagMap[tag.second->uid] = symbols.get(tag.first);
     }
     // TODO const params
     forEachNode(get_root(), [&result, &tagMap](NodeWrapper * node, NodeWrapper * parent){
+        const std::string id = std::to_string(node->uid);
         if (parent) {
             RawEdge childEdge;
             childEdge.src = std::to_string(parent->uid);
-            childEdge.dst = std::to_string(node->uid);
+            childEdge.dst = id;
             childEdge.type = std::make_unique<std::string>(nodeRelationToString(NodeRelation::CHILD));
             result.edges.push_back(std::move(childEdge));
         }
         for (auto && relation : node->get_relations()) {
             RawEdge relationEdge;
-            relationEdge.src = std::to_string(node->uid);
+            relationEdge.src = id;
             relationEdge.dst = std::to_string(relation.node->uid);
             relationEdge.type = std::make_unique<std::string>(nodeRelationToString(relation.relation));
             result.edges.push_back(std::move(relationEdge));
         }
         RawNode rawNode;
-        rawNode.id = std::to_string(node->uid);
-        rawNode.name = std::make_unique<std::string>(node->name);
-        rawNode.locked = node->locked;
-        rawNode.enabled = node->enabled;
+        rawNode.id = id;
+        rawNode.name = std::make_unique<std::string>(node->get_name());
+        rawNode.locked = node->is_locked();
+        rawNode.enabled = node->is_enabled();
         rawNode.parent_enabled = node->parent_enabled;
         rawNode.parent_locked = node->parent_locked;
         rawNode.is_compute = std::make_unique<bool>(node->is_compute());
         rawNode.color = std::make_unique<unsigned>(node->color);
         if (node->is_compute()) {
-            rawNode.compute_params = std::make_unique<std::vector<precission>>(node->_compute_additional_params);
-            rawNode.compute_fct = std::make_unique<std::string>(node->compute_function_name);
+            rawNode.compute_params = std::make_unique<std::vector<precission>>(node->_compute_additional_params.begin(), node->_compute_additional_params.end());
+            rawNode.compute_fct = std::make_unique<std::string>(node->get_compute_function_name());
         }
 
         if (tagMap.count(node->uid)) {
             rawNode.tag = std::make_unique<std::string>(tagMap[node->uid]);
         }
 
-        if (node->_is_group) {
+        if (node->is_group()) {
             rawNode.type = "Group";
         } else if (node->is_point()) {
             rawNode.type = "VP";
             rawNode.role = std::make_unique<std::string>(roleToString(node->role));
-            rawNode.direction = std::make_unique<Quaternion>(QuaternionAsVector3(node->as_vanishingPoint().get_direction()));
-            rawNode.direction_local = std::make_unique<Quaternion>(QuaternionAsVector3(node->as_vanishingPoint().get_direction_local()));
+            const VanishingPoint & vp = static_cast<const NodeWrapper *>(node)->as_vanishingPoint();
+            rawNode.direction = std::make_unique<Quaternion>(QuaternionAsVector3(vp.get_direction()));
+            rawNode.direction_local = std::make_unique<Quaternion>(QuaternionAsVector3(vp.get_direction_local()));
         } else if (node->is_projection()) {
-            if (node->_is_curvilinear) {
+            if (node->is_curvilinear()) {
                 rawNode.type = "CurvilinearPerspective";
             } else {
                 rawNode.type = "RectilinearProjection";
             }
-            rawNode.right = std::make_unique<Complex>(node->as_projection()->calc_pos_from_dir(Quaternion(1, 0, 1, 0)));
-            rawNode.left = std::make_unique<Complex>(node->as_projection()->calc_pos_from_dir(Quaternion(-1, 0, 1, 0)));
+            // saved in model space, display transform is not part of graph
+            const Projection * projection = node->as_projection();
+            rawNode.right = std::make_unique<Complex>(projection->display_to_model(projection->calc_pos_from_dir(Quaternion(1, 0, 1, 0))));
+            rawNode.left = std::make_unique<Complex>(projection->display_to_model(projection->calc_pos_from_dir(Quaternion(-1, 0, 1, 0))));
         } else if (node->is_space()) {
             rawNode.type = "Space";
             rawNode.is_UI = std::make_unique<int>(1);
             rawNode.rotation =  std::make_unique<Quaternion>(node->as_space().get_rotation());
             rawNode.rotation_local =  std::make_unique<Quaternion>(node->as_space().get_rotation_local());
-        } else if (node->_is_plane) {
+        } else if (node->is_plane()) {
             rawNode.type = "Plane";
         } else {
             throw std::runtime_error("unknown node type");
@@ -576,6 +1419,7 @@ RawGraph GraphBase::to_raw_data() {
 }
 
 NodeWrapper * GraphBase::create_from_structure(RawGraph& data){
+    StructureEdit edit(*this);
     _is_empty = false;
 
     if (data.version) {
@@ -592,26 +1436,36 @@ NodeWrapper * GraphBase::create_from_structure(RawGraph& data){
 
     const std::string & root = data.root;
     std::map<std::string, int> idMap;
+    std::vector<NodeWrapper *> created;
+    created.reserve(data.nodes.size());
 
     for (auto && rawNode : data.nodes) {
         std::string dataId = rawNode.id;
-        std::shared_ptr<NodeWrapper> node = node_from_raw_data(rawNode);
+        NodeWrapper * node = store_node(node_from_raw_data(rawNode));
+        created.push_back(node);
         idMap[dataId] = node->uid;
 
-        this->nodes.push_back(node);
-        this->nodeMap[node->uid] = node.get();
+        this->nodeMap[node->uid] = node;
         if (rawNode.tag) {
-            this->tags[*rawNode.tag] = node.get();
+            this->tags[symbols.intern(*rawNode.tag)] = node;
         }
 
         if ((rawNode.type == "RectilinearProjection" || rawNode.type == "CurvilinearPerspective") && this->main_view == nullptr) {
-            this->main_view = node.get();
+            this->main_view = node;
         }
     }
 
     for (auto && rawEdge : data.edges) {
         add_edge( get_by_uid(idMap[rawEdge.dst]), get_by_uid(idMap[rawEdge.src]), rawEdge.type );
     }
+    for (auto && node : created) {
+        if (node->get_parent() == nullptr) {
+            append_tree_to_tour(node);
+        }
+    }
+    invalidate_compute_program();
+    invalidate_update_order();
+    invalidate_point_cache();
 
     if (data.visualizations) {
         for (auto && rawVis : *data.visualizations) {
@@ -632,21 +1486,55 @@ NodeWrapper * GraphBase::create_from_structure(RawGraph& data){
     return get_by_uid(idMap[root]);
 }
 
-NodeWrapper* GraphBase::remove_by_uid ( int uid ){
+NodeWrapper * GraphBase::store_node(std::unique_ptr<NodeWrapper> node) {
+    unsigned slot;
+    if (freeSlots.size()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = nodes.size();
+        nodes.emplace_back();
+    }
+    pointTable.reserve_slots(nodes.size());
+    positionGenerations.resize(nodes.size());
+    positionGenerations[slot] = 0;
+    node->uid = ++lastUid;
+    node->attach_to_graph(this, slot);
+    nodes[slot] = std::move(node);
+    return nodes[slot].get();
+}
+
+void GraphBase::release_node(NodeWrapper * node) {
+    if (node->_change_index >= 0) {
+        changeRecords[node->_change_index].node = nullptr;
+    }
+    unsigned slot = node->_slot;
+    nodes[slot].reset();
+    freeSlots.push_back(slot);
+}
+
+bool GraphBase::remove_by_uid ( int uid ){
     NodeWrapper * node = get_by_uid ( uid );
-    nodeMap.erase ( uid );
-    if ( !node ) {
-        return nullptr;
+    if ( !node || node == _root ) {
+        return false;
     }
-    std::vector<NodeWrapper *> toRemove = get_all_nodes ( node );
-    std::set<int> toRemoveUids;
+    ChangeScope scope(*this);
+    StructureEdit edit(*this);
+    // removed subtree is contiguous range of tour
+    const unsigned first = node->_tour_index;
+    const unsigned count = node->_subtree_size;
+    NodeRange toRemove = get_subtree(node);
+    auto isRemoved = [first, count](const NodeWrapper * other) {
+        return other != nullptr && other->_tour_index >= static_cast<int>(first) && other->_tour_index < static_cast<int>(first + count);
+    };
+    bool removesView = false;
     for (auto && nodeToRemove : toRemove) {
-        toRemoveUids.insert(nodeToRemove->uid);
+        removesView |= nodeToRemove->is_view();
     }
-    
-    auto checkVisualizationForDelete = [&toRemoveUids](VisualizationData & vis){
+
+    auto checkVisualizationForDelete = [this, &isRemoved](VisualizationData & vis){
         for (auto && nodeId : vis.nodes) {
-            if (toRemoveUids.count(nodeId)) {
+            if (isRemoved(get_by_uid(nodeId))) {
                 return true;
             }
         }
@@ -654,14 +1542,143 @@ NodeWrapper* GraphBase::remove_by_uid ( int uid ){
     };
     visualizations.erase ( std::remove_if ( visualizations.begin(), visualizations.end(), checkVisualizationForDelete ),visualizations.end() );
 
-    // FIXME - TODO remove nodes from GraphBase.nodes
-    //              change return value to void,
-    //              rewrite refreshing canvas in myPaint (call ot redraw_points_graph)
+    for (auto it = tags.begin(); it != tags.end();) {
+        if (isRemoved(it->second)) {
+            it = tags.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // detach relations pointing from remaining nodes to removed ones
     NodeWrapper * parent = node->get_parent();
     if ( parent ) {
         parent->remove_child ( node );
-        return node;
     }
-    return nullptr;
+    for (NodeWrapper * ancestor = parent; ancestor != nullptr; ancestor = ancestor->get_parent()) {
+        ancestor->_subtree_size -= count;
+    }
+    for (auto && nodeToRemove : toRemove) {
+        for (auto && relation : nodeToRemove->get_relations()) {
+            if (isRemoved(relation.node)) {
+                continue;
+            }
+            if (relation.relation == NodeRelation::COMPUTE) {
+                relation.node->remove_relation(nodeToRemove, NodeRelation::COMPUTE_SRC);
+            } else if (relation.relation == NodeRelation::COMPUTE_SRC) {
+                relation.node->remove_relation(nodeToRemove, NodeRelation::COMPUTE);
+            }
+        }
+    }
+    if (removesView) {
+        for (auto && storedNode : nodes) {
+            NodeWrapper * view = storedNode ? storedNode->get_view() : nullptr;
+            if (isRemoved(view) && !isRemoved(storedNode.get())) {
+                storedNode->remove_relation(view, NodeRelation::VIEW);
+            }
+        }
+    }
+
+    linkedViews.erase(std::remove_if(linkedViews.begin(), linkedViews.end(), [&isRemoved](const LinkedView & linked) {
+        return isRemoved(linked.view) || isRemoved(linked.source);
+    }), linkedViews.end());
+    pendingSpaces.erase(std::remove_if(pendingSpaces.begin(), pendingSpaces.end(), isRemoved), pendingSpaces.end());
+    if (isRemoved(main_view)) {
+        main_view = nullptr;
+    }
+    if (isRemoved(chosen_point)) {
+        chosen_point = nullptr;
+    }
+    for (auto && nodeToRemove : toRemove) {
+        nodeMap.erase(nodeToRemove->uid);
+        release_node(nodeToRemove);
+    }
+    tour.erase(tour.begin() + first, tour.begin() + first + count);
+    tourFlags.erase(tourFlags.begin() + first, tourFlags.begin() + first + count);
+    reindex_tour(first, tour.size());
+    invalidate_compute_program();
+    invalidate_update_order();
+    invalidate_point_cache();
+    return true;
+}
+
+void GraphBase::clone_into(GraphBase & target) {
+    if (batchDepth != 0 || changeDepth != 0) {
+        throw std::runtime_error("graph can not be cloned during operation");
+    }
+    target.clear();
+    target.nodes.clear();
+    target.nodes.resize(nodes.size());
+    for (unsigned slot = 0; slot < nodes.size(); slot++) {
+        if (nodes[slot]) {
+            target.nodes[slot] = nodes[slot]->clone_to(&target);
+        }
+    }
+    // node of this graph -> node of target in the same slot
+    auto map = [&target](const NodeWrapper * node) {
+        return node != nullptr ? target.nodes[node->_slot].get() : nullptr;
+    };
+    for (auto && node : target.nodes) {
+        if (node) {
+            node->remap_nodes(map);
+        }
+    }
+    target.freeSlots = freeSlots;
+    target.lastUid = lastUid;
+    target.symbols = symbols;
+    target.pointTable = pointTable.share();
+    target.visualizations = visualizations;
+    for (auto && item : nodeMap) {
+        target.nodeMap[item.first] = map(item.second);
+    }
+    for (auto && item : tags) {
+        target.tags[item.first] = map(item.second);
+    }
+    target.tour.clear();
+    target.tour.reserve(tour.size());
+    for (auto && node : tour) {
+        target.tour.push_back(map(node));
+    }
+    target.tourFlags = tourFlags;
+    target.stateGeneration = stateGeneration;
+    target.pointCacheValid = false;
+    target.pointGrid = pointGrid;
+    target.pointGridValid = pointGridValid;
+    target.gridOutdatedViews.clear();
+    for (auto && view : gridOutdatedViews) {
+        target.gridOutdatedViews.push_back(map(view));
+    }
+    target.positionGenerations = positionGenerations;
+    target.directionIndex = directionIndex;
+    target.directionIndexValid = directionIndexValid;
+    target.linkedViews = linkedViews;
+    for (auto && linked : target.linkedViews) {
+        linked.view = map(linked.view);
+        linked.source = map(linked.source);
+    }
+    target.changes = ChangeSet();
+    target.parallelThreshold = parallelThreshold;
+    target._root = map(_root);
+    target.main_view = map(main_view);
+    target.chosen_point = map(chosen_point);
+    target._is_empty = _is_empty;
 }
 
+GraphMemoryStats GraphBase::get_memory_stats() const {
+    GraphMemoryStats stats = {};
+    stats.slots = nodes.size();
+    stats.free_slots = freeSlots.size();
+    for (auto && node : nodes) {
+        if (!node) {
+            continue;
+        }
+        stats.nodes++;
+        stats.relations += node->get_relations().size();
+        stats.children += node->get_children().size();
+    }
+    stats.uids = nodeMap.size();
+    stats.tags = tags.size();
+    stats.symbols = symbols.size();
+    stats.visualizations = visualizations.size();
+    return stats;
+}
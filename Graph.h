@@ -17,8 +17,10 @@
 */
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <memory>
 #include "Space.h"
 #include "Helpers.h"
@@ -26,6 +28,12 @@
 #include "Projection.h"
 #include "log.h"
 #include "RawData.h"
+#include "ComputeProgram.h"
+#include "SmallVector.h"
+#include "StringInterner.h"
+#include "SpatialGrid.h"
+#include "DirectionIndex.h"
+#include "ThreadPool.h"
 
 class GraphBase;
 
@@ -37,6 +45,29 @@ enum class VPRole : char {
 };
 
 
+/** bits of node flags, see NodeWrapper::get_flags and GraphBase::nodes_where */
+enum NodeFlag : uint32_t {
+    NODE_SPACE = 1 << 0,
+    NODE_VANISHING_POINT = 1 << 1,
+    NODE_POINT = 1 << 2,
+    NODE_VIEW = 1 << 3,
+    NODE_PROJECTION = 1 << 4,
+    NODE_GROUP = 1 << 5,
+    NODE_PLANE = 1 << 6,
+    NODE_CURVILINEAR = 1 << 7,
+    NODE_RECTILINEAR = 1 << 8,
+    NODE_UI = 1 << 9,
+    NODE_GROUPING = 1 << 10,
+    NODE_UI_ONLY = 1 << 11,
+    NODE_COMPUTE = 1 << 12,
+    NODE_ENABLED = 1 << 13,
+    NODE_LOCKED = 1 << 14,
+    NODE_PARENT_ENABLED = 1 << 15,
+    NODE_PARENT_LOCKED = 1 << 16,
+    /** node and all its ancestors are enabled */
+    NODE_VISIBLE = NODE_ENABLED | NODE_PARENT_ENABLED,
+};
+
 /** Enumeration of the relations between nodes in graph */
 enum class NodeRelation : char {
     CHILD = 0,
@@ -86,6 +117,26 @@ struct NodeVariant {
         PerspectiveGroup perspectiveGroup;
     } node;
     NODE_TYPE nodeType = NODE_TYPE::NONE;
+    NodeVariant() = default;
+    NodeVariant(NodeVariant &&) = default;
+    NodeVariant & operator=(NodeVariant &&) = default;
+    /** deep copy of element */
+    NodeVariant(const NodeVariant & other) : nodeType(other.nodeType) {
+        node.plane = other.node.plane;
+        node.perspectiveGroup = other.node.perspectiveGroup;
+        if (other.node.perspectiveSpace) {
+            node.perspectiveSpace = std::make_unique<PerspectiveSpace>(*other.node.perspectiveSpace);
+        }
+        if (other.node.vanishingPoint) {
+            node.vanishingPoint = std::make_unique<VanishingPoint>(*other.node.vanishingPoint);
+        }
+        if (other.node.rectilinearProjection) {
+            node.rectilinearProjection = std::make_unique<RectilinearProjection>(*other.node.rectilinearProjection);
+        }
+        if (other.node.curvilinearPerspective) {
+            node.curvilinearPerspective = std::make_unique<CurvilinearPerspective>(*other.node.curvilinearPerspective);
+        }
+    }
     void set(PerspectiveSpace space) {
         node.perspectiveSpace = std::make_unique<PerspectiveSpace>(space);
         nodeType = NODE_TYPE::PERSPECTIVE_SPACE;
@@ -187,78 +238,126 @@ public:
         NodeWrapper * node;
         NodeRelation relation;
     };
+    /** most nodes have few children and relations, they are stored inline */
+    using ChildList = SmallVector<NodeWrapper *, 4>;
+    using RelationList = SmallVector<RelationItem, 3>;
+    using ParamList = SmallVector<precission, 1>;
+    /** contiguous range of relations of one type */
+    struct RelationRange {
+        const RelationItem * first;
+        const RelationItem * last;
+        const RelationItem * begin() const {
+            return first;
+        }
+        const RelationItem * end() const {
+            return last;
+        }
+        size_t size() const {
+            return last - first;
+        }
+        bool empty() const {
+            return first == last;
+        }
+    };
 private:
+    enum {
+        RELATION_BUCKETS = 4,
+    };
     NodeVariant node;
-    std::vector<RelationItem> _relations;
-    bool isCompute = false;
+    /** relations sorted by type: PARENT, VIEW, COMPUTE, COMPUTE_SRC, insertion order inside type */
+    RelationList _relations;
+    /** _relations[_relation_offsets[i]] is first relation of bucket i */
+    unsigned _relation_offsets[RELATION_BUCKETS + 1] = {};
+    static unsigned relation_bucket(NodeRelation relation) {
+        switch (relation) {
+            case NodeRelation::PARENT:
+                return 0;
+            case NodeRelation::VIEW:
+                return 1;
+            case NodeRelation::COMPUTE:
+                return 2;
+            case NodeRelation::COMPUTE_SRC:
+                return 3;
+            default:
+                throw std::runtime_error("relation type can not be stored");
+        }
+    }
+    /** notify graph after change of relations, \p moved is node with changed parent, nullptr if tree is the same */
+    void relations_changed(NodeWrapper * moved);
+    void erase_relation(unsigned index, unsigned bucket) {
+        _relations.erase(_relations.begin() + index);
+        for (unsigned i = bucket + 1; i <= RELATION_BUCKETS; i++) {
+            _relation_offsets[i]--;
+        }
+    }
+    /** NodeFlag bits describing node type */
+    uint32_t _flags = 0;
+    void set_flag(uint32_t flag, bool value);
+    /** changed only by set_enabled and set_locked, graph mirrors them in flag column and caches */
+    bool _enabled = true;
+    bool _locked = false;
 public:
-    bool enabled = true;
-    bool locked = false;
     VPRole role = VPRole::NORMAL;
-    int uid;
-    std::string name;
-    std::vector<NodeWrapper *> _children;
-    std::vector<precission> _compute_additional_params;
+    /** unique in graph, assigned when node is stored in graph, 0 before */
+    int uid = 0;
+    /** name in string interner of graph */
+    SymbolId _name = 0;
+    ChildList _children;
+    ParamList _compute_additional_params;
     unsigned color = 0; // rgba
-    void (NodeWrapper::* _compute)(std::vector<NodeWrapper*>,std::vector<precission>) = nullptr;
-    std::string compute_function_name;
+    ComputeKernelId _compute_kernel = 0;
+    int _program_index = -1;
+    int _update_index = -1;
+    /** index in change records of graph, -1 if node was not changed by current operation */
+    int _change_index = -1;
+    /** position in GraphBase pre-order layout, subtree is range of _subtree_size nodes starting here */
+    int _tour_index = -1;
+    unsigned _subtree_size = 1;
+    GraphBase * _graph = nullptr;
+    unsigned _slot = 0;
     bool parent_enabled = true;
     bool parent_locked = false;
-    bool _is_space = false;
-    bool _is_vanishing_point = false;
-    bool _is_point = false;
-    bool _is_view = false;
-    bool _is_projection = false;
-    bool _is_group = false;
-    bool _is_plane = false;
-    bool _is_curvilinear = false;
-    bool _is_rectilinear = false;
-    bool _is_UI = false;
-    bool _is_grouping = false;
-    bool _is_UI_only = false;
 
 private:
-    static int getNextUID();
+    /** name of node not added to graph yet */
+    std::unique_ptr<std::string> _detached_name;
+    /** copy of node data, see clone_to */
+    NodeWrapper(const NodeWrapper & other);
 public:
     NodeWrapper(const std::string & name) {
-        uid = getNextUID();
-        this->name = name;
+        _detached_name = std::make_unique<std::string>(name);
+    }
+    const std::string & get_name() const;
+    /** same as get_name, replaces former public member name, node->name becomes node->name() */
+    const std::string & name() const {
+        return get_name();
     }
+    void set_name(const std::string & name);
+    /** name of compute function, empty if node has no compute function */
+    const std::string & get_compute_function_name() const;
     NodeWrapper(PerspectiveSpace &space, const std::string & name) : NodeWrapper(name) {
         node.set(space);
-        _is_space = true;
-        _is_grouping = true;
+        _flags = NODE_SPACE | NODE_GROUPING;
     }
     NodeWrapper(Plane &plane, const std::string & name) : NodeWrapper(name) {
         node.set(plane);
-        _is_plane = true;
+        _flags = NODE_PLANE;
     }
     NodeWrapper(VanishingPoint &vp, const std::string & name) : NodeWrapper(name) {
         node.set(vp);
-        _is_vanishing_point = true;
-        _is_point = true;
-        _is_UI = true;
+        _flags = NODE_VANISHING_POINT | NODE_POINT | NODE_UI;
     }
     NodeWrapper(RectilinearProjection &projection, const std::string & name) : NodeWrapper(name) {
         node.set(projection);
-        _is_view = true;
-        _is_projection = true;
-        _is_rectilinear = true;
-        _is_grouping = true;
+        _flags = NODE_VIEW | NODE_PROJECTION | NODE_RECTILINEAR | NODE_GROUPING;
     }
     NodeWrapper(CurvilinearPerspective &projection, const std::string & name) : NodeWrapper(name) {
         node.set(projection);
-        _is_view = true;
-        _is_projection = true;
-        _is_curvilinear = true;
-        _is_grouping = true;
+        _flags = NODE_VIEW | NODE_PROJECTION | NODE_CURVILINEAR | NODE_GROUPING;
     }
     NodeWrapper(PerspectiveGroup &group, const std::string & name) : NodeWrapper(name) {
         node.set(group);
-        _is_group = true;
-        _is_UI = true;
-        _is_grouping = true;
-        _is_UI_only = true;
+        _flags = NODE_GROUP | NODE_UI | NODE_GROUPING | NODE_UI_ONLY;
     }
     const PerspectiveSpace & as_space() const {
         return node.get<PerspectiveSpace>();
@@ -272,11 +371,25 @@ public:
     Plane & as_plane() {
         return const_cast<Plane &>(static_cast<const NodeWrapper &>(*this).as_plane());
     }
-    const VanishingPoint & as_vanishingPoint() const {
-        return node.get<VanishingPoint>();
-    }
-    VanishingPoint & as_vanishingPoint() {
-        return const_cast<VanishingPoint &>(static_cast<const NodeWrapper &>(*this).as_vanishingPoint());
+    /** VP data is stored in GraphBase point table after node is added to graph */
+    const VanishingPoint & as_vanishingPoint() const;
+    /** writable VP data, point table chunk shared with cloned graph is copied first, use const node to read */
+    VanishingPoint & as_vanishingPoint();
+    /** set owner of node, name is interned and VP data is moved to point table of \p graph */
+    void attach_to_graph(GraphBase * graph, unsigned slot);
+    /**
+     * copy of node owned by \p graph in the same slot, used by GraphBase::clone,
+     * children and relations point to nodes of source graph until remap_nodes
+     */
+    std::unique_ptr<NodeWrapper> clone_to(GraphBase * graph) const;
+    /** replace pointers to children and related nodes by \p map(node) */
+    template<typename Map> void remap_nodes(Map map) {
+        for (auto && child : _children) {
+            child = map(child);
+        }
+        for (auto && relation : _relations) {
+            relation.node = map(relation.node);
+        }
     }
     const Projection * as_projection() const {
         if (node.is(NodeVariant::NODE_TYPE::RECTILINEAR_PROJECTION)) {
@@ -291,9 +404,8 @@ public:
     PerspectiveGroup & as_group() {
         return node.get<PerspectiveGroup>();
     }
-    Complex get_position() {
-        return as_vanishingPoint().get_position();
-    }
+    /** position on canvas, recomputed first if view was transformed after last update */
+    Complex get_position();
     /** Update perspective space using change in its node position */
     void update_space(const VanishingPoint & child_node, const Quaternion & new_dir) {
         as_space().update_space(child_node, new_dir);
@@ -301,42 +413,60 @@ public:
     void update_subspace(NodeWrapper * subspace) {
         as_space().update_subspace(subspace->as_space());
     }
-    void update_child(NodeWrapper * child_node, const Complex & new_position) {
-        as_projection()->update_child(child_node->as_vanishingPoint(), new_position);
-    }
-    void update_child(NodeWrapper * child_node) {
-        if (!child_node->_is_plane) {
-            auto & vp = child_node->as_vanishingPoint();
-            auto p = as_projection();
-            p->update_child(vp);
-        }
-    }
+    void update_child(NodeWrapper * child_node, const Complex & new_position);
+    void update_child(NodeWrapper * child_node);
     void update_child_dir(NodeWrapper * child_node) {
         as_space().update_child_dir(child_node->as_vanishingPoint());
     }
     // TODO make private?
     void add_child(NodeWrapper * child){
         _children.push_back(child);
+        relations_changed(child);
     }
-    const std::vector<NodeWrapper*> & get_children() const {
+    const ChildList & get_children() const {
         return _children;
     }
-    std::vector<NodeWrapper*> & get_children() {
+    ChildList & get_children() {
         return _children;
     }
     void add_relative(NodeWrapper * node, NodeRelation relation) {
-        _relations.push_back(RelationItem{
+        unsigned bucket = relation_bucket(relation);
+        _relations.insert(_relations.begin() + _relation_offsets[bucket + 1], RelationItem{
             .node = node,
             .relation = relation,
         });
+        for (unsigned i = bucket + 1; i <= RELATION_BUCKETS; i++) {
+            _relation_offsets[i]++;
+        }
+        relations_changed(relation == NodeRelation::PARENT ? this : nullptr);
     }
-    const std::vector<NodeWrapper::RelationItem> & get_relations() const {
+    const RelationList & get_relations() const {
         return _relations;
     }
+    RelationRange get_relations_of_type(NodeRelation relation) const {
+        unsigned bucket = relation_bucket(relation);
+        const RelationItem * data = _relations.data();
+        return RelationRange{
+            .first = data + _relation_offsets[bucket],
+            .last = data + _relation_offsets[bucket + 1],
+        };
+    }
+    /** remove first relation of type \p relation with \p node */
+    void remove_relation(NodeWrapper * node, NodeRelation relation) {
+        unsigned bucket = relation_bucket(relation);
+        for (unsigned i = _relation_offsets[bucket]; i < _relation_offsets[bucket + 1]; i++) {
+            if (_relations[i].node == node) {
+                erase_relation(i, bucket);
+                relations_changed(relation == NodeRelation::PARENT ? this : nullptr);
+                return;
+            }
+        }
+    }
     void remove_child(NodeWrapper * child) {
         for (auto it = _children.begin(); it != _children.end();) {
             if (*it == child) {
                 _children.erase(it);
+                relations_changed(child);
                 break;
             } else {
                 ++it;
@@ -348,38 +478,29 @@ public:
         add_relative(parent, NodeRelation::PARENT);
     }
     void set_parent(NodeWrapper * parent) {
-        for (auto it = _relations.begin(); it != _relations.end();) {
-            if (it->relation == NodeRelation::PARENT) {
-                _relations.erase(it);
-                break;
-            }
+        if (_relation_offsets[1] != 0) {
+            erase_relation(0, 0);
         }
         add_relative(parent, NodeRelation::PARENT);
     }
     NodeWrapper * get_first_relation_of_type(NodeRelation relation) {
-        for (auto && item : _relations) {
-            if (item.relation == relation) {
-                return item.node;
-            }
-        }
-        return nullptr;
+        RelationRange range = get_relations_of_type(relation);
+        return range.empty() ? nullptr : range.first->node;
     }
     NodeWrapper * get_parent() {
-        return get_first_relation_of_type(NodeRelation::PARENT);
+        return _relation_offsets[1] != 0 ? _relations[0].node : nullptr;
     }
 
     void add_view(NodeWrapper * view) {
         add_relative(view, NodeRelation::VIEW);
     }
     NodeWrapper * get_view() {
-        return get_first_relation_of_type(NodeRelation::VIEW);
+        return _relation_offsets[2] != _relation_offsets[1] ? _relations[_relation_offsets[1]].node : nullptr;
     }
     std::vector<NodeWrapper*> get_compute_children() {
         std::vector<NodeWrapper*> result;
-        for (auto && item : _relations) {
-            if (item.relation == NodeRelation::COMPUTE) {
-                result.push_back(item.node);
-            }
+        for (auto && item : get_relations_of_type(NodeRelation::COMPUTE)) {
+            result.push_back(item.node);
         }
         return result;
     }
@@ -387,7 +508,7 @@ public:
         if (!is_vanishing_point()) {
             return "";
         } else {
-            Quaternion direction = as_vanishingPoint().get_direction();
+            Quaternion direction = static_cast<const NodeWrapper *>(this)->as_vanishingPoint().get_direction();
             auto angles = vector_to_angle(direction);
             auto focalLenth = vector_to_lens_mm(direction);
             // TODO move to python
@@ -397,47 +518,26 @@ public:
     }
     std::shared_ptr<PerspectiveLine> get_line(Complex origin) {
         NodeWrapper * view = get_view();
-        return view->as_projection()->get_line(as_vanishingPoint(), origin);
+        return view->as_projection()->get_line(static_cast<const NodeWrapper *>(this)->as_vanishingPoint(), origin);
     }
     void clear_compute_sources() {
-        for (auto relationIt = _relations.begin(); relationIt != _relations.end();) {
-            if (relationIt->relation == NodeRelation::COMPUTE_SRC) {
-                NodeWrapper * node = relationIt->node;
-                for (auto relation2it = node->_relations.begin(); relation2it != node->_relations.end();) {
-                    if (relation2it->relation == NodeRelation::COMPUTE) {
-                        if (relation2it->node == this) {
-                            relation2it = node->_relations.erase(relation2it);
-                            continue;
-                        }
-                    }
-                    ++ relation2it;
-                }
-                relationIt = _relations.erase(relationIt);
-            } else {
-                ++relationIt;
-            }
+        while (_relation_offsets[4] != _relation_offsets[3]) {
+            unsigned last = _relation_offsets[4] - 1;
+            NodeWrapper * src = _relations[last].node;
+            erase_relation(last, 3);
+            src->remove_relation(this, NodeRelation::COMPUTE);
         }
+        relations_changed(nullptr);
     }
-    void update_compute_point_source(GraphBase * graph, std::vector<NodeWrapper*> sources) {
-        clear_compute_sources();
-        for (auto && src : sources) {
-            src->add_relative(this, NodeRelation::COMPUTE);
-            this->add_relative(src, NodeRelation::COMPUTE_SRC);
-        }
-        compute(graph);
-    }
-    void set_compute_additional_params(precission param) {
-        _compute_additional_params = {param};
-    }
-    void set_compute_fct_by_name(std::string name) {
-        _compute = compute_functions(name);
-        compute_function_name = name;
-    }
+    void update_compute_point_source(GraphBase * graph, std::vector<NodeWrapper*> sources);
+    void set_compute_additional_params(precission param);
+    void set_compute_fct_by_name(std::string name);
+    /** recompute node and all nodes depending on it */
     void compute(GraphBase * graph);
-    void compute_plane(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
+    void compute_plane(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
         auto & plane = as_plane();
-        auto source_size = src.size();
+        auto source_size = args.src_count;
         if (source_size == 1) {
             plane.set_normal(src[0]->as_vanishingPoint().get_direction());
         } else if (source_size == 2) {
@@ -450,8 +550,8 @@ public:
         }
     }
     /** compute horizontally mirrored point */
-    void compute_mirrored_points(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
+    void compute_mirrored_points(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
         Quaternion srcVector = normalize(src[0]->as_vanishingPoint().get_direction());
         as_vanishingPoint().set_direction(Quaternion(
             srcVector.x,
@@ -461,22 +561,27 @@ public:
         ));
     }
     /** compute measure points */
-    void compute_measure_points (std::vector<NodeWrapper*> src,std::vector<precission> params) {
-        precission direction = params[0];
+    void compute_measure_points (const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
+        precission direction = args.params_count ? args.params[0] : 0;
         Quaternion baseVector = Quaternion(direction, 0, 0, 0);
         Quaternion srcVector = src[0]->as_vanishingPoint().get_direction();
         _compute_measure_points(baseVector, srcVector);
     }
     /** compute measure points from 2 VPs */
-    void compute_measure_points_2 (std::vector<NodeWrapper*> src,std::vector<precission> params) {
-        precission direction = params[0];
+    void compute_measure_points_2 (const ComputeArgs & args) {
+        if (args.src_count < 2) {
+            return;
+        }
+        const NodeWrapper * const * src = args.src;
+        precission direction = args.params_count ? args.params[0] : 0;
         Quaternion baseVector = src[0]->as_vanishingPoint().get_direction().scalar_mul(direction);
         Quaternion srcVector = src[1]->as_vanishingPoint().get_direction();
         _compute_measure_points(baseVector, srcVector);
     }
-    void compute_cross_product(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
-        auto sourceSize = src.size();
+    void compute_cross_product(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
+        auto sourceSize = args.src_count;
         if (sourceSize != 2) {
             return;
         } else {
@@ -486,9 +591,9 @@ public:
             as_vanishingPoint().set_direction(normal);
         }
     }
-    void compute_2d_direction(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
-        auto sourceSize = src.size();
+    void compute_2d_direction(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
+        auto sourceSize = args.src_count;
         if (sourceSize != 2) {
             return;
         } else {
@@ -497,9 +602,9 @@ public:
             as_vanishingPoint().set_direction(direction);
         }
     }
-    void compute_2d_direction_90(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
-        auto sourceSize = src.size();
+    void compute_2d_direction_90(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
+        auto sourceSize = args.src_count;
         if (sourceSize != 2) {
             return;
         } else {
@@ -509,25 +614,29 @@ public:
             as_vanishingPoint().set_direction(direction);
         }
     }
-    void compute_horizon_1(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
+    void compute_horizon_1(const ComputeArgs & args) {
+        const NodeWrapper * const * src = args.src;
         Plane & plane = as_plane();
         Quaternion elevation = src[0]->as_vanishingPoint().get_direction();
         Quaternion side = Quaternion(1, 0, 0, 0);
         Quaternion normal = normalize(cross(elevation, side));
         plane.set_normal(normal);
     }
-    void compute_space_2p_rect(std::vector<NodeWrapper*> src,std::vector<precission> unused) {
-        (void) unused;
-        Plane & plane = src[0]->as_plane();
-        NodeWrapper* base = src[1];
-        NodeWrapper* direction = src[2];
+    void compute_space_2p_rect(const ComputeArgs & args) {
+        if (args.src_count < 3) {
+            return;
+        }
+        const NodeWrapper * const * src = args.src;
+        const Plane & plane = src[0]->as_plane();
+        const NodeWrapper * base = src[1];
+        const NodeWrapper * direction = src[2];
 
         Quaternion planeNormal = plane.get_normal();
         auto * projection = get_view()->as_projection();
 
-        Quaternion baseRay = projection->calc_direction(base->get_position());
-        Quaternion dirRay = projection->calc_direction(direction->get_position());
+        // positions of sources were refreshed by ComputeProgram, see ComputeKernel::reads_positions
+        Quaternion baseRay = projection->calc_direction(base->as_vanishingPoint().get_position());
+        Quaternion dirRay = projection->calc_direction(direction->as_vanishingPoint().get_position());
 
         precission baseRayDotSign = dot(planeNormal, baseRay);
         precission dirRayDotSign = dot(planeNormal, dirRay);
@@ -551,30 +660,6 @@ public:
         space.update_global_rotation(rectRotation * planeRotation);
     }
 
-    void (NodeWrapper::* compute_functions(std::string name))(std::vector<NodeWrapper*>,std::vector<precission>)  {
-        if (name == "plane") {
-            return &NodeWrapper::compute_plane;
-        } else if (name == "compute_mirrored_points") {
-            return &NodeWrapper::compute_mirrored_points;
-        } else if (name == "compute_measure_points") {
-            return &NodeWrapper::compute_measure_points;
-        } else if (name == "compute_measure_points_2") {
-            return &NodeWrapper::compute_measure_points_2;
-        } else if (name == "cross_product") {
-            return &NodeWrapper::compute_cross_product;
-        } else if (name == "2d_direction") {
-            return &NodeWrapper::compute_2d_direction;
-        } else if (name == "2d_direction_90") {
-            return &NodeWrapper::compute_2d_direction_90;
-        } else if (name == "horizon_1") {
-            return &NodeWrapper::compute_horizon_1;
-        } else if (name == "space_2p_rect") {
-            return &NodeWrapper::compute_space_2p_rect;
-        } else {
-            throw std::runtime_error("unknown compute function");
-        }
-        return nullptr;
-    }
     // TODO private
     /** compute measure points */
     void _compute_measure_points(const Quaternion & base_vector, const Quaternion & src_vector) {
@@ -587,11 +672,12 @@ public:
         as_vanishingPoint().set_direction(dstDirection);
     }
     // TODO private
-    Complex _compute_2d_direction(NodeWrapper * src0, NodeWrapper * src1) {
+    Complex _compute_2d_direction(const NodeWrapper * src0, const NodeWrapper * src1) {
         Quaternion direction_1 = src0->as_vanishingPoint().get_direction();
         Quaternion direction_2 = src1->as_vanishingPoint().get_direction();
         Quaternion normal = normalize(cross(direction_1, direction_2));
         as_vanishingPoint().set_direction(normal);
+        // positions of sources were refreshed by ComputeProgram, see ComputeKernel::reads_positions
         Complex pos_1 = src0->as_vanishingPoint().get_position();
         Complex pos_2 = src1->as_vanishingPoint().get_position();
         return Complex(pos_2.real() - pos_1.real(), pos_2.imag() - pos_1.imag());
@@ -599,53 +685,76 @@ public:
     void update_toggle_from_parent() {
         NodeWrapper * parent = get_parent();
         if (parent) {
-            parent_enabled = parent->enabled && parent->parent_enabled;
+            parent_enabled = parent->_enabled && parent->parent_enabled;
         }
     }
     void update_lock_from_parent() {
         NodeWrapper * parent = get_parent();
         if (parent) {
-            parent_locked = parent->locked || parent->parent_locked;
+            parent_locked = parent->_locked || parent->parent_locked;
         }
     }
     bool is_point() const {
-        return _is_point;
+        return _flags & NODE_POINT;
     }
     bool is_vanishing_point() const {
-        return _is_vanishing_point;
+        return _flags & NODE_VANISHING_POINT;
     }
     bool is_UI() const {
-        return _is_UI;
+        return _flags & NODE_UI;
     }
     void set_UI(bool value) {
-        _is_UI = value;
+        set_flag(NODE_UI, value);
     }
     bool is_UI_only() const {
-        return _is_UI_only;
+        return _flags & NODE_UI_ONLY;
     }
     bool is_space() const {
-        return _is_space;
+        return _flags & NODE_SPACE;
     }
     bool is_view() const {
-        return _is_view;
+        return _flags & NODE_VIEW;
     }
     bool is_projection() const {
-        return _is_projection;
+        return _flags & NODE_PROJECTION;
     }
-    bool is_grouping() const {
-        return _is_grouping;
+    bool is_group() const {
+        return _flags & NODE_GROUP;
     }
-    bool is_compute() const {
-        return isCompute;
+    bool is_plane() const {
+        return _flags & NODE_PLANE;
     }
-    void set_compute(bool compute) {
-        isCompute = compute;
+    bool is_curvilinear() const {
+        return _flags & NODE_CURVILINEAR;
     }
-    void toggle() {
-        enabled ^= true;
+    bool is_rectilinear() const {
+        return _flags & NODE_RECTILINEAR;
     }
-    void lock() {
-        locked ^= true;
+    bool is_grouping() const {
+        return _flags & NODE_GROUPING;
+    }
+    bool is_compute() const {
+        return _flags & NODE_COMPUTE;
+    }
+    /** type flags with enabled/locked state, NodeFlag bits */
+    uint32_t get_flags() const {
+        return _flags
+            | (_enabled ? NODE_ENABLED : 0u)
+            | (_locked ? NODE_LOCKED : 0u)
+            | (parent_enabled ? NODE_PARENT_ENABLED : 0u)
+            | (parent_locked ? NODE_PARENT_LOCKED : 0u);
+    }
+    void set_compute(bool compute);
+    /** enabled and locked state should be changed only by methods below, they update state of subtree */
+    void toggle();
+    void lock();
+    void set_enabled(bool value);
+    void set_locked(bool value);
+    bool is_enabled() const {
+        return _enabled;
+    }
+    bool is_locked() const {
+        return _locked;
     }
     bool is_key() const {
         return role == VPRole::KEY;
@@ -655,19 +764,337 @@ public:
     }
 };
 
+/** load shared library with additional compute functions, see ComputeRegistry::load_plugin */
+inline void load_compute_plugin(const std::string & path) {
+    ComputeRegistry::instance().load_plugin(path);
+}
+
+/**
+ * Geometry of vanishing points (position, direction, local direction) indexed by NodeWrapper::_slot,
+ * kept apart from node metadata. Stored in fixed size chunks, so references stay valid when graph grows.
+ * Chunks are shared with tables made by share and copied before first write.
+ */
+class PointTable {
+public:
+    enum : unsigned {
+        CHUNK_BITS = 8,
+        CHUNK_SIZE = 1 << CHUNK_BITS,
+    };
+private:
+    struct Chunk {
+        std::shared_ptr<std::vector<VanishingPoint>> storage;
+        VanishingPoint * data;
+        /** storage may be used by other table, set in both tables by share */
+        bool shared;
+    };
+    std::vector<Chunk> chunks;
+    /** indexed by slot, incremented by every writable access */
+    std::vector<unsigned> generations;
+
+    Chunk & writable(unsigned index) {
+        Chunk & chunk = chunks[index];
+        if (chunk.shared) {
+            // shared storage is never written, even if other table released it, so tables need no synchronization
+            chunk.storage = std::make_shared<std::vector<VanishingPoint>>(*chunk.storage);
+            chunk.data = chunk.storage->data();
+            chunk.shared = false;
+        }
+        return chunk;
+    }
+public:
+    PointTable() = default;
+    PointTable(PointTable &&) = default;
+    PointTable & operator=(PointTable &&) = default;
+    /** copy would share chunks without copy on write, use share */
+    PointTable(const PointTable &) = delete;
+    PointTable & operator=(const PointTable &) = delete;
+
+    /** table with the same content sharing all chunks with this one, chunks of both tables become copy on write */
+    PointTable share() {
+        PointTable result;
+        result.chunks = chunks;
+        result.generations = generations;
+        for (auto && chunk : chunks) {
+            chunk.shared = true;
+        }
+        for (auto && chunk : result.chunks) {
+            chunk.shared = true;
+        }
+        return result;
+    }
+    /**
+     * copy chunk of \p slot if it is still shared with other table, writes of different slots from
+     * different threads are safe only after their chunks were detached, writable() is not synchronized
+     */
+    void detach(unsigned slot) {
+        writable(slot >> CHUNK_BITS);
+    }
+    /** make room for slots [0, \p size) */
+    void reserve_slots(unsigned size) {
+        while (chunks.size() * CHUNK_SIZE < size) {
+            auto storage = std::make_shared<std::vector<VanishingPoint>>(CHUNK_SIZE);
+            VanishingPoint * data = storage->data();
+            chunks.push_back(Chunk{std::move(storage), data, false});
+        }
+        generations.resize(chunks.size() * CHUNK_SIZE, 0);
+    }
+    void clear() {
+        chunks.clear();
+        generations.clear();
+    }
+    /** writable point, its generation is incremented */
+    VanishingPoint & operator[](unsigned slot) {
+        generations[slot]++;
+        return writable(slot >> CHUNK_BITS).data[slot & (CHUNK_SIZE - 1)];
+    }
+    const VanishingPoint & operator[](unsigned slot) const {
+        return chunks[slot >> CHUNK_BITS].data[slot & (CHUNK_SIZE - 1)];
+    }
+    /** contiguous block of CHUNK_SIZE entries, slots starting at \p index * CHUNK_SIZE */
+    VanishingPoint * chunk(unsigned index) {
+        for (unsigned slot = index * CHUNK_SIZE; slot < (index + 1) * CHUNK_SIZE; slot++) {
+            generations[slot]++;
+        }
+        return writable(index).data;
+    }
+    /** changed by every writable access of \p slot, data derived from point is outdated when it differs */
+    unsigned get_generation(unsigned slot) const {
+        return generations[slot];
+    }
+    unsigned chunk_count() const {
+        return chunks.size();
+    }
+};
+
+/** Memory usage of graph, counted in elements */
+struct GraphMemoryStats {
+    size_t nodes;
+    size_t slots;
+    size_t free_slots;
+    size_t relations;
+    size_t children;
+    size_t uids;
+    size_t tags;
+    size_t symbols;
+    size_t visualizations;
+};
+
+/** nodes changed by one operation, see GraphBase::get_changes */
+struct ChangeSet {
+    /** uids of nodes with changed position, direction or enabled state */
+    std::vector<int> uids;
+    /** bounds of changed visible points before and after operation: min x, min y, max x, max y, empty if there is no such point */
+    std::vector<precission> old_bounds;
+    std::vector<precission> new_bounds;
+    /** nodes were added or removed or view was transformed, whole graph should be redrawn */
+    bool structure_changed = false;
+};
+
 struct VisualizationData {
     std::string type;
     std::vector<int> nodes;
     std::vector<precission> data;
 };
 
+/**
+ * Immutable copy of render state of graph, see GraphBase::get_render_snapshot.
+ * Vanishing points of _root tree in pre-order, i-th element of each column describes the same point.
+ */
+struct RenderSnapshot {
+    /** incremented with every published snapshot of graph */
+    unsigned generation = 0;
+    std::vector<int> uids;
+    /** stored positions, outdated after lazy reprojection of view, see get_position */
+    std::vector<Complex> positions;
+    std::vector<Quaternion> directions;
+    /** NodeFlag bits, point is drawn if (flags & NODE_VISIBLE) == NODE_VISIBLE */
+    std::vector<uint32_t> flags;
+    /** uid of view of point, -1 if point has no view */
+    std::vector<int> views;
+    /** index to projections if position of point is outdated, -1 if it is current */
+    std::vector<int> outdated;
+    /** copies of views with outdated points */
+    std::vector<std::shared_ptr<const Projection>> projections;
+    std::vector<VisualizationData> visualizations;
+
+    /** current position of i-th point, outdated position is projected by reader */
+    Complex get_position(size_t i) const {
+        return outdated[i] < 0 ? positions[i] : projections[outdated[i]]->calc_pos_from_dir(directions[i]);
+    }
+};
+
 
+/**
+ * Graph of perspective elements, owns its nodes.
+ * Thread safety: all mutable state (nodes, uids, names, caches) belongs to graph, so different graphs
+ * can be loaded and used in different threads at the same time. Single graph must be used by one thread
+ * at a time, except get_render_snapshot which may be called from any thread.
+ * State shared by graphs is synchronized: ComputeRegistry and ThreadPool::instance (busy pool runs jobs serially).
+ * Python conversions (PythonGraph) need GIL.
+ */
 class GraphBase {
+public:
+    /** contiguous range of nodes in pre-order */
+    struct NodeRange {
+        NodeWrapper * const * first;
+        NodeWrapper * const * last;
+        NodeWrapper * const * begin() const {
+            return first;
+        }
+        NodeWrapper * const * end() const {
+            return last;
+        }
+        size_t size() const {
+            return last - first;
+        }
+    };
+
 private:
     std::map<int, NodeWrapper*> nodeMap;
-    std::map<std::string, NodeWrapper*> tags;
-    std::vector<std::shared_ptr<NodeWrapper>> nodes;
+    /** tag symbol -> node */
+    std::unordered_map<SymbolId, NodeWrapper*> tags;
+    StringInterner symbols;
+    /** node storage, indexed by NodeWrapper::_slot, empty slots are listed in freeSlots */
+    std::vector<std::unique_ptr<NodeWrapper>> nodes;
+    std::vector<unsigned> freeSlots;
+    /** last uid given to node, uids are not reused, also after clear */
+    int lastUid = 0;
+    PointTable pointTable;
     std::vector<VisualizationData> visualizations;
+    ComputeProgram computeProgram;
+
+    /**
+     * node in pre-order traversal used by update_groups, indexed by NodeWrapper::_update_index,
+     * steps inside node are in range (_update_index, end)
+     */
+    struct UpdateStep {
+        NodeWrapper * node;
+        /** space and view used to update node */
+        NodeWrapper * space;
+        NodeWrapper * view;
+        unsigned end;
+    };
+    /** all nodes in pre-order, every subtree is contiguous range, see get_subtree */
+    std::vector<NodeWrapper *> tour;
+    /** NodeWrapper::get_flags of nodes in tour */
+    std::vector<uint32_t> tourFlags;
+    std::vector<UpdateStep> updateOrder;
+    bool updateOrderValid = false;
+    /** scratch buffer reused by update, no allocations after first call */
+    std::vector<NodeWrapper *> updateComputeNodes;
+    /** spaces rotated inside batch, updated at commit */
+    std::vector<NodeWrapper *> pendingSpaces;
+    unsigned batchDepth = 0;
+    /** enabled points and enabled unlocked points from _root tree, in pre-order */
+    std::vector<NodeWrapper *> enabledPoints;
+    std::vector<NodeWrapper *> unlockedPoints;
+    std::vector<NodeWrapper *> statePoints;
+    bool pointCacheValid = false;
+    unsigned stateGeneration = 0;
+    /** canvas positions of points from _root tree, NodeWrapper::_slot is id in grid */
+    SpatialGrid pointGrid;
+    bool pointGridValid = false;
+    /** views with outdated positions of their points in pointGrid, points are updated by next build_point_grid */
+    std::vector<NodeWrapper *> gridOutdatedViews;
+    /**
+     * indexed by NodeWrapper::_slot, for view: generation of its center, size and rotation,
+     * for vanishing point: generation of its view used to compute its position
+     */
+    std::vector<unsigned> positionGenerations;
+    /** view showing points of other view, positions are cached per node slot */
+    struct LinkedView {
+        NodeWrapper * view;
+        /** view of nodes shown in view */
+        NodeWrapper * source;
+        std::vector<Complex> positions;
+        /** generation of view used to compute position, INVALID_GENERATION if position was not computed */
+        std::vector<unsigned> generations;
+        /** PointTable::get_generation of node used to compute position */
+        std::vector<unsigned> pointGenerations;
+    };
+    enum : unsigned {
+        INVALID_GENERATION = ~0u,
+    };
+    std::vector<LinkedView> linkedViews;
+    LinkedView & get_linked_view(const NodeWrapper * view);
+    /** last published snapshot, shared with readers, accessed only with atomic_load and atomic_store */
+    std::shared_ptr<const RenderSnapshot> renderSnapshot;
+    /** writable alias of renderSnapshot and previous snapshot, buffers are reused when no reader holds it */
+    std::shared_ptr<RenderSnapshot> publishedSnapshot;
+    std::shared_ptr<RenderSnapshot> spareSnapshot;
+    bool publishSnapshots = false;
+    /** views of outdated points in last published snapshot, index is RenderSnapshot::outdated */
+    std::vector<const NodeWrapper *> snapshotOutdatedViews;
+    /** directions of vanishing points from _root tree, NodeWrapper::_slot is id in index */
+    DirectionIndex directionIndex;
+    bool directionIndexValid = false;
+
+    struct ChangeRecord {
+        /** nullptr if node was removed */
+        NodeWrapper * node;
+        /** position before change, valid if visible */
+        Complex position;
+        bool visible;
+    };
+    /** journal of current operation, indexed by NodeWrapper::_change_index */
+    std::vector<ChangeRecord> changeRecords;
+    /** change record of \p node with its current position */
+    ChangeRecord make_change_record(NodeWrapper * node) const;
+    /** add record made by make_change_record, ignored if node is already in change set */
+    void add_change_record(const ChangeRecord & record);
+    /** result of update of one part of group, parts are merged in traversal order */
+    struct UpdateTask {
+        unsigned begin;
+        unsigned end;
+        std::vector<NodeWrapper *> computeNodes;
+        std::vector<ChangeRecord> records;
+    };
+    std::vector<UpdateTask> updateTasks;
+    /** update_groups of groups and compute groups with at least this many steps run on thread pool */
+    unsigned parallelThreshold = 2048;
+    /** pool used by update_groups, nullptr - shared ThreadPool::instance */
+    ThreadPool * threadPool = nullptr;
+    /** update steps [\p begin, \p end), \p record is called for every changed node before its change */
+    template<typename Record> void update_steps(unsigned begin, unsigned end, std::vector<NodeWrapper *> & computeNodes, Record record);
+    ChangeSet changes;
+    unsigned changeDepth = 0;
+    /** open change set, nested operations add to change set of outermost one */
+    void begin_changes();
+    /** close change set, compute bounds when outermost operation ends */
+    void finish_changes();
+    /** graph keeps tour, update order and compute program in sync itself, relations_changed is ignored */
+    unsigned structureEditDepth = 0;
+    class StructureEdit {
+    private:
+        GraphBase & graph;
+    public:
+        StructureEdit(GraphBase & graph) : graph(graph) {
+            graph.structureEditDepth++;
+        }
+        StructureEdit(const StructureEdit &) = delete;
+        StructureEdit & operator=(const StructureEdit &) = delete;
+        ~StructureEdit() {
+            graph.structureEditDepth--;
+        }
+    };
+    /** rebuild tour from children lists, trees are kept in their current order */
+    void rebuild_tour();
+    /** change set for duration of operation, \p open false adopts level opened by begin_batch */
+    class ChangeScope {
+    private:
+        GraphBase & graph;
+    public:
+        ChangeScope(GraphBase & graph, bool open = true) : graph(graph) {
+            if (open) {
+                graph.begin_changes();
+            }
+        }
+        ChangeScope(const ChangeScope &) = delete;
+        ChangeScope & operator=(const ChangeScope &) = delete;
+        ~ChangeScope() {
+            graph.finish_changes();
+        }
+    };
 public:
     NodeWrapper * _root = nullptr;
     NodeWrapper * main_view = nullptr;
@@ -684,27 +1111,85 @@ private:
     NewElementData get_group_for_new_element();
     void createRoot() {
         PerspectiveGroup tmpRoot = PerspectiveGroup();
-        auto rootPtr = std::shared_ptr<NodeWrapper>(new NodeWrapper(tmpRoot, "root"));
-        nodes.push_back(rootPtr);
-        _root = rootPtr.get();
-    }
+        _root = store_node(std::make_unique<NodeWrapper>(tmpRoot, "root"));
+        append_tree_to_tour(_root);
+    }
+    /** take ownership of node, reuse free slot if possible */
+    NodeWrapper * store_node(std::unique_ptr<NodeWrapper> node);
+    /** destroy node and return its slot to free list */
+    void release_node(NodeWrapper * node);
+    /** append pre-order of tree with root \p root at the end of tour */
+    void append_tree_to_tour(NodeWrapper * root);
+    /** update NodeWrapper::_tour_index and flags of nodes in range [\p begin, \p end) */
+    void reindex_tour(unsigned begin, unsigned end);
+    /** append enabled (and unlocked if \p skipLocked) points from \p range to \p result */
+    void collect_points(NodeRange range, bool skipLocked, std::vector<NodeWrapper *> & result);
+    /** replace points of subtree of \p node in cached list \p points */
+    void update_cached_points(NodeWrapper * node, bool skipLocked, std::vector<NodeWrapper *> & points);
+    /** true if \p space (if \p includeSelf) or one of its ancestor spaces waits for update */
+    bool has_pending_space(const NodeWrapper * space, bool includeSelf) const;
+    /** update nodes of spaces rotated inside batch and mark their compute nodes */
+    void update_pending_spaces();
+    /** rebuild pointGrid if graph structure changed, otherwise update points of gridOutdatedViews */
+    void build_point_grid();
+    /** true if \p node is in subtree of _root */
+    bool is_in_root_tree(const NodeWrapper * node) const {
+        const int rootBegin = _root->_tour_index;
+        return node->_tour_index >= rootBegin && node->_tour_index < rootBegin + static_cast<int>(_root->_subtree_size);
+    }
+    /** rebuild directionIndex if graph structure changed */
+    void build_direction_index();
+    /** true if \p node is enabled (and unlocked if \p skipLocked) according to flag column */
+    bool is_pickable(const NodeWrapper * node, bool skipLocked) const;
+    /** rebuild updateOrder if graph structure changed */
+    void build_update_order();
+    /** bump generation of \p view, positions of its points are recomputed on access */
+    void outdate_view_positions(NodeWrapper * view);
+    /** positions of points of \p view in pick grid are updated by next build_point_grid */
+    void outdate_grid_positions(NodeWrapper * view);
+    /** move up-to-date positions of rectilinear \p view with similarity transform from old to current view state */
+    void transform_view_positions(NodeWrapper * view, const Complex & oldCenter, const Complex & oldScale);
+    /** recompute compute nodes reading positions of points of \p view, deferred to commit inside batch */
+    void recompute_view_dependent(NodeWrapper * view);
 protected:
     RawGraph to_raw_data();
+    /** make empty \p target copy of this graph, see clone */
+    void clone_into(GraphBase & target);
 public:
     GraphBase() {
         clear();
     }
 
+    /** remove all nodes, throws inside batch */
     void clear() {
+        if (batchDepth) {
+            throw std::runtime_error("graph can not be cleared inside batch");
+        }
         _is_empty = true;
         _root = nullptr;
         main_view = nullptr;
         chosen_point = nullptr;
         nodes.clear();
+        freeSlots.clear();
+        pointTable.clear();
+        positionGenerations.clear();
+        linkedViews.clear();
+        tour.clear();
+        tourFlags.clear();
         nodeMap.clear();
         tags.clear();
+        symbols.clear();
+        pendingSpaces.clear();
+        changeRecords.clear();
+        changes = ChangeSet();
         visualizations.clear();
+        computeProgram.invalidate();
+        updateOrderValid = false;
+        invalidate_point_cache();
         createRoot();
+        if (publishSnapshots) {
+            publish_snapshot();
+        }
     }
 
     NodeWrapper * get_root() {
@@ -726,26 +1211,31 @@ public:
 
     /** initialize graph from data */
     void initialize_from_structure(RawGraph & data) {
+        ChangeScope scope(*this);
         NodeWrapper * localRoot = create_from_structure(data);
         _root = localRoot;
+        update_state(_root);
         std::vector<NodeWrapper *> computeNodes;
         for (auto && child : localRoot->get_children()) {
             std::vector<NodeWrapper*> tmp = update_groups(child);
             computeNodes.insert(computeNodes.end(), tmp.begin(), tmp.end());
         }
+        ComputeProgram & program = get_compute_program();
         for (auto && computeNode :computeNodes) {
-            computeNode->compute(this);
+            program.mark(computeNode);
         }
+        program.run(*this);
     }
 
     NodeWrapper * create_from_structure(RawGraph & data);
 
     NodeWrapper * get_by_tag(const std::string & tag) {
-        if (tags.count(tag)) {
-            return tags[tag];
-        } else {
+        SymbolId symbol;
+        if (!symbols.find(tag, symbol)) {
             return nullptr;
         }
+        auto it = tags.find(symbol);
+        return it != tags.end() ? it->second : nullptr;
     }
 
     NodeWrapper * get_by_uid(int uid) {
@@ -756,11 +1246,208 @@ public:
         }
     }
 
-    NodeWrapper * remove_by_uid(int uid);
+    /**
+     * remove node with its subtree, detach all relations and release memory
+     * @return false if there is no such node or it is graph root,
+     * API change: removed node was returned before, now it does not exist after call (Python gets bool)
+     */
+    bool remove_by_uid(int uid);
+
+    GraphMemoryStats get_memory_stats() const;
+
+    /**
+     * independent copy of graph, nodes keep their slots and uids,
+     * nodes, names and indexes are copied (one allocation per node), only point geometry is shared
+     * and copied per point table chunk on first write of either graph,
+     * compute program and update order are rebuilt on first use,
+     * clone uses shared ThreadPool::instance, pool set by set_thread_pool is not copied because it may not outlive clone,
+     * graph must not be inside batch or operation, clone can be used in other thread than this graph
+     */
+    std::unique_ptr<GraphBase> clone() {
+        auto result = std::make_unique<GraphBase>();
+        clone_into(*result);
+        return result;
+    }
+
+    /** strings used by nodes of graph */
+    StringInterner & get_symbols() {
+        return symbols;
+    }
+
+    const StringInterner & get_symbols() const {
+        return symbols;
+    }
+
+    /** geometry of all vanishing points in graph */
+    PointTable & get_point_table() {
+        return pointTable;
+    }
+
+    const PointTable & get_point_table() const {
+        return pointTable;
+    }
+
+    /** \p node and all its descendants in pre-order, valid until next change of graph structure */
+    NodeRange get_subtree(const NodeWrapper * node) const {
+        if (node->_tour_index < 0) {
+            throw std::runtime_error("node is not in graph");
+        }
+        NodeWrapper * const * first = tour.data() + node->_tour_index;
+        return NodeRange{
+            .first = first,
+            .last = first + node->_subtree_size,
+        };
+    }
+
+    /**
+     * nodes from subtree of \p root (whole graph if nullptr) with (flags & \p mask) == \p value, in pre-order
+     * e.g. enabled UI points: nodes_where(NODE_VISIBLE | NODE_UI | NODE_POINT, NODE_VISIBLE | NODE_UI | NODE_POINT, view)
+     */
+    std::vector<NodeWrapper *> nodes_where(uint32_t mask, uint32_t value, const NodeWrapper * root = nullptr) const;
+
+    /** copy flags of \p node to flag column, called after change of node type flags */
+    void sync_flags(const NodeWrapper * node) {
+        if (node->_tour_index >= 0) {
+            tourFlags[node->_tour_index] = node->get_flags();
+        }
+    }
 
     std::vector<NodeWrapper *> get_points(NodeWrapper * nodeToDraw);
 
-    std::vector<NodeWrapper *> get_all_enabled_points(bool skipLocked = false);
+    std::vector<NodeWrapper *> get_all_enabled_points(bool skipLocked = false) {
+        return get_enabled_points(skipLocked);
+    }
+
+    /** enabled points (and unlocked if \p skipLocked) in pre-order, list is cached between changes */
+    const std::vector<NodeWrapper *> & get_enabled_points(bool skipLocked = false);
+
+    /** incremented after every change of graph structure or of enabled/locked state */
+    unsigned get_state_generation() const {
+        return stateGeneration;
+    }
+
+    /** propagate enabled/locked state of \p node to its subtree and update cached point lists */
+    void update_state(NodeWrapper * node);
+
+    void invalidate_point_cache() {
+        pointCacheValid = false;
+        pointGridValid = false;
+        gridOutdatedViews.clear();
+        directionIndexValid = false;
+        for (auto && linked : linkedViews) {
+            linked.generations.clear();
+        }
+        changes.structure_changed = true;
+        stateGeneration++;
+    }
+
+    /** enabled point nearest to \p pos not further than \p radius, nullptr if there is no such point */
+    NodeWrapper * pick(Complex pos, precission radius, bool skipLocked = false);
+
+    /** enabled points with position inside \p bbox, in pre-order */
+    std::vector<NodeWrapper *> points_in_rect(const BBox & bbox, bool skipLocked = false);
+
+    /** \p k enabled vanishing points with direction angularly closest to \p direction, sorted from closest */
+    std::vector<NodeWrapper *> nearest_directions(const Quaternion & direction, unsigned k, bool skipLocked = false);
+
+    /**
+     * mark positions of points of \p view outdated after change of its center, size or rotation,
+     * positions are recomputed on first access instead of updating all nodes of view,
+     * compute nodes using positions in \p view are recomputed
+     */
+    void invalidate_view(NodeWrapper * view);
+
+    /**
+     * change center, rotation and size of \p view, for rectilinear view points of its subtree are moved
+     * with single similarity transform, other positions are updated lazily
+     */
+    void set_view_transform(NodeWrapper * view, const Complex & center, const Complex & rotation, precission size);
+
+    /** set display transform of \p view, see Projection::set_display_transform, positions are updated lazily */
+    void set_view_display_transform(NodeWrapper * view, const Affine2D & transform) {
+        view->as_projection()->set_display_transform(transform);
+        invalidate_view(view);
+    }
+
+    /**
+     * show nodes of \p source view also through projection of \p view, directions are shared,
+     * positions in \p view are cached separately and updated on access, see get_position_in_view
+     */
+    void link_view(NodeWrapper * view, NodeWrapper * source);
+
+    void unlink_view(NodeWrapper * view);
+
+    /** views linked to \p source */
+    std::vector<NodeWrapper *> get_linked_views(const NodeWrapper * source) const;
+
+    /** position of \p node in \p view, view of node or view linked to it */
+    Complex get_position_in_view(NodeWrapper * node, NodeWrapper * view);
+
+    /** positions of \p points in \p view, see get_position_in_view */
+    std::vector<Complex> get_positions_in_view(const std::vector<NodeWrapper *> & points, NodeWrapper * view) {
+        std::vector<Complex> result;
+        result.reserve(points.size());
+        for (auto && point : points) {
+            result.push_back(get_position_in_view(point, view));
+        }
+        return result;
+    }
+
+    /** publish snapshot at the end of every operation changing graph, publishes current state when enabled */
+    void set_publish_snapshots(bool enabled) {
+        publishSnapshots = enabled;
+        if (enabled) {
+            publish_snapshot();
+        }
+    }
+
+    /**
+     * copy render state to new snapshot and make it visible to readers,
+     * outdated positions are not refreshed, snapshot holds copies of their views instead
+     */
+    void publish_snapshot();
+
+    /**
+     * last published snapshot, nullptr before first one, the only method which may be called
+     * from other thread while graph is modified, snapshot stays valid and unchanged as long as it is held
+     */
+    std::shared_ptr<const RenderSnapshot> get_render_snapshot() const {
+        return std::atomic_load(&renderSnapshot);
+    }
+
+    /** recompute outdated positions of enabled points in subtree of \p root (whole graph if nullptr) in single pass */
+    void refresh_positions(NodeWrapper * root = nullptr);
+
+    /** recompute position of \p node if its view was transformed since last update */
+    void refresh_position(NodeWrapper * node) {
+        NodeWrapper * view = node->get_view();
+        if (view == nullptr) {
+            return;
+        }
+        const unsigned viewGeneration = positionGenerations[view->_slot];
+        unsigned & generation = positionGenerations[node->_slot];
+        if (generation != viewGeneration) {
+            generation = viewGeneration;
+            view->as_projection()->update_child(node->as_vanishingPoint());
+        }
+    }
+
+    /** true if view of \p node was transformed since last update of its position */
+    bool is_position_outdated(const NodeWrapper * node, const NodeWrapper * view) const {
+        return positionGenerations[node->_slot] != positionGenerations[view->_slot];
+    }
+
+    /** position of \p node was computed from current state of \p view */
+    void stamp_position(const NodeWrapper * node, const NodeWrapper * view) {
+        if (node->_graph == this && view->_graph == this) {
+            positionGenerations[node->_slot] = positionGenerations[view->_slot];
+        }
+    }
+
+    /** cell size of grid used by pick and points_in_rect, should be close to typical pick radius */
+    void set_pick_cell_size(precission size) {
+        pointGrid.set_cell_size(size);
+    }
 
     std::vector<NodeWrapper *> get_all_nodes(NodeWrapper * parent);
 
@@ -812,8 +1499,95 @@ public:
 
     std::vector<NodeWrapper *> update_groups(NodeWrapper * group);
 
+    /**
+     * update nodes in \p group (view or space) in single pass over precomputed traversal order,
+     * append compute nodes which need recomputation to \p computeNodes
+     */
+    void update_groups(NodeWrapper * group, std::vector<NodeWrapper *> & computeNodes);
+
+    /**
+     * groups with at least \p steps nodes in traversal order are updated in parallel,
+     * independent subtrees of group (spaces, points) are tasks of ThreadPool,
+     * the same limit applies to number of independent compute nodes computed together
+     */
+    void set_parallel_threshold(unsigned steps) {
+        parallelThreshold = steps;
+    }
+
+    unsigned get_parallel_threshold() const {
+        return parallelThreshold;
+    }
+
+    /** use \p pool instead of shared pool, pool must outlive graph */
+    void set_thread_pool(ThreadPool & pool) {
+        threadPool = &pool;
+    }
+
+    /** pool used for parallel updates */
+    ThreadPool & get_thread_pool() {
+        return threadPool ? *threadPool : ThreadPool::instance();
+    }
+
+    /** move \p node to \p pos, inside batch recomputation is delayed until commit */
     void update(NodeWrapper * node, Complex pos);
 
+    /**
+     * start batch of updates, nodes depending on moved points are recomputed once at commit,
+     * batches can be nested, see also GraphBatch
+     */
+    void begin_batch();
+
+    /** end batch started by begin_batch, update groups and compute nodes changed in batch */
+    void commit();
+
+    /**
+     * end batch without update, used when batch is interrupted by error,
+     * nodes depending on points moved in batch are not recomputed until they are updated again
+     */
+    void abort_batch();
+
+    bool is_in_batch() const {
+        return batchDepth != 0;
+    }
+
+    /**
+     * nodes changed by last update, commit, change of enabled state or of graph structure,
+     * used by UI to redraw only changed part of canvas
+     */
+    const ChangeSet & get_changes() const {
+        return changes;
+    }
+
+    /** add \p node to change set of current operation, ignored outside of operation */
+    void record_change(NodeWrapper * node);
+
+    /** return compute program, compiled again if graph structure changed */
+    ComputeProgram & get_compute_program();
+
+    /** called after change of parent-child relations, traversal order is rebuilt before next update */
+    void invalidate_update_order() {
+        updateOrderValid = false;
+    }
+
+    /**
+     * called by NodeWrapper after its relations were changed outside of graph methods,
+     * compute program and update order are rebuilt, tour is rebuilt if \p moved got new parent or was detached
+     */
+    void relations_changed(NodeWrapper * moved);
+
+    /** called after change of relations between nodes or compute functions */
+    void invalidate_compute_program() {
+        computeProgram.invalidate();
+    }
+
+    /** recompute \p node and all compute nodes depending on it */
+    void recompute(NodeWrapper * node) {
+        ChangeScope scope(*this);
+        ComputeProgram & program = get_compute_program();
+        program.mark(node);
+        program.run(*this);
+    }
+
     /** modify \p dst, convert it to compute node
      * @param dst node converted to compute node
      * @param sources nodes connected no \p dst as compute function parameters
@@ -828,6 +1602,7 @@ public:
         dst->set_compute(true);
         dst->set_compute_additional_params(value);
         dst->set_compute_fct_by_name(fctName);
+        invalidate_compute_program();
         dst->compute(this);
     }
 
@@ -839,4 +1614,90 @@ public:
     }
 };
 
+/**
+ * batch of updates, begin_batch in constructor, commit in destructor,
+ * batch left by exception is aborted, errors of commit in destructor are logged
+ */
+class GraphBatch {
+private:
+    GraphBase & graph;
+    bool open = true;
+public:
+    explicit GraphBatch(GraphBase & graph) : graph(graph) {
+        graph.begin_batch();
+    }
+    GraphBatch(const GraphBatch &) = delete;
+    GraphBatch & operator=(const GraphBatch &) = delete;
+    /** commit before end of scope, errors are thrown instead of logged */
+    void commit() {
+        open = false;
+        graph.commit();
+    }
+    ~GraphBatch() {
+        if (!open) {
+            return;
+        }
+        try {
+            if (std::uncaught_exception()) {
+                graph.abort_batch();
+            } else {
+                graph.commit();
+            }
+        } catch (const std::exception & e) {
+            LogErr("batch commit failed: ", e.what());
+        }
+    }
+};
+
+inline const VanishingPoint & NodeWrapper::as_vanishingPoint() const {
+    if (_graph != nullptr && is_vanishing_point()) {
+        return static_cast<const GraphBase *>(_graph)->get_point_table()[_slot];
+    }
+    return node.get<VanishingPoint>();
+}
+
+inline VanishingPoint & NodeWrapper::as_vanishingPoint() {
+    if (_graph != nullptr && is_vanishing_point()) {
+        return _graph->get_point_table()[_slot];
+    }
+    return node.get<VanishingPoint>();
+}
+
+inline void NodeWrapper::relations_changed(NodeWrapper * moved) {
+    if (_graph != nullptr) {
+        _graph->relations_changed(moved);
+    }
+}
 
+inline Complex NodeWrapper::get_position() {
+    if (_graph != nullptr) {
+        _graph->refresh_position(this);
+    }
+    // read only access, point table chunk shared with cloned graph stays shared
+    return static_cast<const NodeWrapper *>(this)->as_vanishingPoint().get_position();
+}
+
+inline void NodeWrapper::update_child(NodeWrapper * child_node, const Complex & new_position) {
+    as_projection()->update_child(child_node->as_vanishingPoint(), new_position);
+    if (_graph != nullptr) {
+        _graph->stamp_position(child_node, this);
+    }
+}
+
+inline void NodeWrapper::update_child(NodeWrapper * child_node) {
+    if (!child_node->is_plane()) {
+        auto & vp = child_node->as_vanishingPoint();
+        auto p = as_projection();
+        p->update_child(vp);
+        if (_graph != nullptr) {
+            _graph->stamp_position(child_node, this);
+        }
+    }
+}
+
+inline const std::string & NodeWrapper::get_name() const {
+    if (_detached_name) {
+        return *_detached_name;
+    }
+    return _graph->get_symbols().get(_name);
+}
@@ -44,6 +44,7 @@ private:
     Quaternion dir_local;
     Quaternion direction;
 public:
+    VanishingPoint() = default;
     explicit VanishingPoint(const Complex & pos) : BasePoint(pos) {
     }
     explicit VanishingPoint(const Quaternion & direction) : BasePoint() {
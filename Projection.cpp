@@ -141,7 +141,7 @@ public:
         Complex start = this->projection->internal_position_to_model(
                             this->horizon_anchor_pos
                         );
-        Complex direction = this->horizon_dir_2d * this->projection->get_rotation() * this->projection->get_size();
+        Complex direction = this->projection->internal_vector_to_model(this->horizon_dir_2d);
         result.push_back(start - direction);
         result.push_back(start);
         result.push_back(start + direction);
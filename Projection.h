@@ -19,6 +19,7 @@
 #include "Point.h"
 #include <vector>
 #include <memory>
+#include <stdexcept>
 #include "log.h"
 
 
@@ -41,12 +42,58 @@ public:
     virtual std::vector<Complex> for_bbox(const Complex & corner_a, const Complex & corner_b) = 0;
 };
 
-/** Common methods for more complex perspective prjections */
+/**
+ * 2D affine transform, same layout as cairo matrix:
+ * x' = xx * x + xy * y + x0, y' = yx * x + yy * y + y0
+ */
+struct Affine2D {
+    precission xx = 1;
+    precission yx = 0;
+    precission xy = 0;
+    precission yy = 1;
+    precission x0 = 0;
+    precission y0 = 0;
+
+    Complex apply(const Complex & pos) const {
+        return apply_linear(pos) + Complex(x0, y0);
+    }
+    /** transform vector, translation is not used */
+    Complex apply_linear(const Complex & v) const {
+        return Complex(xx * v.real() + xy * v.imag(), yx * v.real() + yy * v.imag());
+    }
+    bool is_identity() const {
+        return xx == 1 && yx == 0 && xy == 0 && yy == 1 && x0 == 0 && y0 == 0;
+    }
+    Affine2D inverse() const {
+        precission det = xx * yy - xy * yx;
+        if (det == 0) {
+            throw std::runtime_error("affine transform is not invertible");
+        }
+        Affine2D result;
+        result.xx = yy / det;
+        result.yx = -yx / det;
+        result.xy = -xy / det;
+        result.yy = xx / det;
+        Complex offset = result.apply_linear(Complex(x0, y0));
+        result.x0 = -offset.real();
+        result.y0 = -offset.imag();
+        return result;
+    }
+};
+
+/**
+ * Common methods for more complex perspective prjections
+ * Positions returned and accepted by projection are in model space, or in display space if display transform is set.
+ */
 class Projection {
 protected:
     Complex center;
     Complex rotation;
     precission size;
+    /** model to display transform and its inverse */
+    Affine2D display;
+    Affine2D displayInverse;
+    bool hasDisplay = false;
 public:
     virtual ~Projection(){}
     Projection(const Complex & left_pos, const Complex & right_pos) {
@@ -94,8 +141,39 @@ public:
         this->rotation = rotation;
     }
 
+    /**
+     * set model to display transform (zoom, rotation and mirror of canvas view),
+     * output positions of projection are in display space, input positions are expected in display space
+     */
+    void set_display_transform(const Affine2D & transform) {
+        displayInverse = transform.inverse();
+        display = transform;
+        hasDisplay = !transform.is_identity();
+    }
+
+    const Affine2D & get_display_transform() const {
+        return display;
+    }
+
+    /** convert position from model space to output space of projection */
+    Complex model_to_display(const Complex & pos) const {
+        return hasDisplay ? display.apply(pos) : pos;
+    }
+
+    /** convert position from output space of projection to model space */
+    Complex display_to_model(const Complex & pos) const {
+        return hasDisplay ? displayInverse.apply(pos) : pos;
+    }
+
+    /** internal position to output position, display transform is folded in */
     Complex internal_position_to_model(const Complex & pos) const {
-        return pos * rotation * size + center;
+        return model_to_display(pos * rotation * size + center);
+    }
+
+    /** internal vector (difference of positions) to output space */
+    Complex internal_vector_to_model(const Complex & v) const {
+        Complex modelVector = v * rotation * size;
+        return hasDisplay ? display.apply_linear(modelVector) : modelVector;
     }
 
     virtual void update_child(VanishingPoint & vp) {
@@ -126,7 +204,7 @@ public:
      *  internal space is transformed with center, size and rotation properties
      */
     Complex model_position_to_internal(const Complex & position) const {
-        return ((position - center) / size * std::conj(rotation));
+        return ((display_to_model(position) - center) / size * std::conj(rotation));
     }
 };
 
@@ -153,18 +231,20 @@ public:
         if (direction.z == 0) {
             return Complex(1024*1024*1024, 1024*1024*1024);
         }
-        precission scale = size / direction.z;
-        return Complex(direction.x * scale, direction.y * scale) * rotation + center;
+        return internal_position_to_model(Complex(direction.x / direction.z, direction.y / direction.z));
     }
 
     Complex get_direction_2d(const VanishingPoint & vp, const Complex & start_position) const {
         Quaternion direction = vp.get_direction();
-        Complex sp = start_position;
+        Complex sp = display_to_model(start_position);
         sp -= center;
         Complex d = sp + Complex(direction.x, direction.y) * rotation;
         precission scale = size / (size + direction.z);
         d *= scale;
         Complex dir_vec = sp - d;
+        if (hasDisplay) {
+            dir_vec = display.apply_linear(dir_vec);
+        }
         precission vec_len = std::hypot(dir_vec.real(), dir_vec.imag());
         return dir_vec / vec_len;
     }
@@ -187,8 +267,7 @@ public:
         for( auto && pos : positions) {
             Quaternion intersection = this->intersect_view_ray_canvas(pos);
             Complex position_2d = Complex(intersection.x, intersection.y);
-            Complex position = position_2d * size * rotation + center;
-            result.push_back(position);
+            result.push_back(internal_position_to_model(position_2d));
         }
         return result;
     }
@@ -45,4 +45,10 @@ public:
         RawGraph graph = GraphBase::to_raw_data();
         return raw_data_to_python(graph);
     }
+    /** see GraphBase::clone, caller takes ownership */
+    PythonGraph * clone_graph() {
+        auto result = std::make_unique<PythonGraph>();
+        clone_into(*result);
+        return result.release();
+    }
 };
@@ -17,7 +17,9 @@
 */
 #pragma once
 #include <cmath>
+#include <cstdio>
 #include <sstream>
+#include <string>
 #include <complex>
 
 using precission = double;
@@ -81,9 +83,9 @@ public:
         return { -this->x, -this->y, -this->z, this->w };
     }
     // TODO rename
-    char* __str__ () const {
-        static char tmp[1024];
-        sprintf(tmp, "Q(%g, %g, %g, %g)", x, y, z, w);
+    std::string __str__ () const {
+        char tmp[128];
+        snprintf(tmp, sizeof(tmp), "Q(%g, %g, %g, %g)", x, y, z, w);
         return tmp;
     }
     static constexpr Quaternion FORWARD() {
@@ -0,0 +1,222 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+
+/**
+ * Vector with inline storage for first N elements, heap is used only when size exceeds N.
+ * Limited to trivially copyable types, elements are moved with memcpy/memmove.
+ */
+template<typename T, unsigned N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector supports only trivially copyable types");
+    static_assert(N > 0, "SmallVector needs inline capacity");
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+    using reverse_iterator = std::reverse_iterator<T *>;
+    using const_reverse_iterator = std::reverse_iterator<const T *>;
+private:
+    T * _data;
+    unsigned _size = 0;
+    unsigned _capacity = N;
+    T _inline[N];
+
+    bool is_inline() const {
+        return _data == _inline;
+    }
+    void grow(unsigned minCapacity) {
+        unsigned capacity = std::max(minCapacity, _capacity * 2);
+        T * data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        if (_size) {
+            std::memcpy(data, _data, _size * sizeof(T));
+        }
+        release();
+        _data = data;
+        _capacity = capacity;
+    }
+    void release() {
+        if (!is_inline()) {
+            ::operator delete(_data);
+        }
+    }
+    void steal(SmallVector & other) {
+        if (other.is_inline()) {
+            assign(other.begin(), other.end());
+        } else {
+            release();
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = other._inline;
+            other._capacity = N;
+        }
+        other._size = 0;
+    }
+public:
+    SmallVector() : _data(_inline) {
+    }
+    SmallVector(std::initializer_list<T> values) : SmallVector() {
+        assign(values.begin(), values.end());
+    }
+    SmallVector(const SmallVector & other) : SmallVector() {
+        assign(other.begin(), other.end());
+    }
+    SmallVector(SmallVector && other) : SmallVector() {
+        steal(other);
+    }
+    SmallVector & operator=(const SmallVector & other) {
+        if (this != &other) {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+    SmallVector & operator=(SmallVector && other) {
+        if (this != &other) {
+            steal(other);
+        }
+        return *this;
+    }
+    SmallVector & operator=(std::initializer_list<T> values) {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+    ~SmallVector() {
+        release();
+    }
+
+    template<typename It> void assign(It first, It last) {
+        clear();
+        reserve(std::distance(first, last));
+        for (; first != last; ++first) {
+            _data[_size++] = *first;
+        }
+    }
+    void reserve(unsigned capacity) {
+        if (capacity > _capacity) {
+            grow(capacity);
+        }
+    }
+    void push_back(const T & value) {
+        if (_size == _capacity) {
+            T copy = value;
+            grow(_size + 1);
+            _data[_size++] = copy;
+        } else {
+            _data[_size++] = value;
+        }
+    }
+    void pop_back() {
+        --_size;
+    }
+    iterator insert(const_iterator position, const T & value) {
+        unsigned index = position - _data;
+        T copy = value;
+        if (_size == _capacity) {
+            grow(_size + 1);
+        }
+        std::memmove(_data + index + 1, _data + index, (_size - index) * sizeof(T));
+        _data[index] = copy;
+        ++_size;
+        return _data + index;
+    }
+    iterator erase(const_iterator position) {
+        return erase(position, position + 1);
+    }
+    iterator erase(const_iterator first, const_iterator last) {
+        unsigned index = first - _data;
+        unsigned count = last - first;
+        std::memmove(_data + index, _data + index + count, (_size - index - count) * sizeof(T));
+        _size -= count;
+        return _data + index;
+    }
+    void clear() {
+        _size = 0;
+    }
+
+    unsigned size() const {
+        return _size;
+    }
+    unsigned capacity() const {
+        return _capacity;
+    }
+    bool empty() const {
+        return _size == 0;
+    }
+    /** true if elements are stored on heap */
+    bool is_allocated() const {
+        return !is_inline();
+    }
+
+    T * data() {
+        return _data;
+    }
+    const T * data() const {
+        return _data;
+    }
+    T & operator[](unsigned index) {
+        return _data[index];
+    }
+    const T & operator[](unsigned index) const {
+        return _data[index];
+    }
+    T & front() {
+        return _data[0];
+    }
+    const T & front() const {
+        return _data[0];
+    }
+    T & back() {
+        return _data[_size - 1];
+    }
+    const T & back() const {
+        return _data[_size - 1];
+    }
+
+    iterator begin() {
+        return _data;
+    }
+    iterator end() {
+        return _data + _size;
+    }
+    const_iterator begin() const {
+        return _data;
+    }
+    const_iterator end() const {
+        return _data + _size;
+    }
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+};
@@ -0,0 +1,175 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Helpers.h"
+
+/**
+ * Uniform grid over canvas positions, only cells containing entries are stored.
+ * Entries are identified by small unsigned ids (node slots), each id has at most one position.
+ */
+class SpatialGrid {
+public:
+    struct Entry {
+        unsigned id;
+        Complex position;
+    };
+private:
+    struct Location {
+        uint64_t cell;
+        /** index in cell, -1 if id is not in grid */
+        int index;
+    };
+    precission cellSize;
+    std::unordered_map<uint64_t, std::vector<Entry>> cells;
+    /** indexed by id */
+    std::vector<Location> locations;
+    unsigned count = 0;
+
+    /** huge positions (points close to horizon) share outermost cells, differences of coords do not overflow */
+    int64_t cell_coord(precission value) const {
+        const precission limit = 4503599627370496.0; // 2^52
+        const precission cell = std::floor(value / cellSize);
+        if (!(cell > -limit)) {
+            return -static_cast<int64_t>(limit);
+        }
+        return static_cast<int64_t>(std::min(cell, limit));
+    }
+    static uint64_t cell_key(int64_t x, int64_t y) {
+        return (static_cast<uint64_t>(x) << 32) ^ static_cast<uint32_t>(y);
+    }
+    uint64_t cell_of(const Complex & position) const {
+        return cell_key(cell_coord(position.real()), cell_coord(position.imag()));
+    }
+    static bool contains(const BBox & bbox, const Complex & position) {
+        return position.real() >= bbox.min_x && position.real() <= bbox.max_x
+            && position.imag() >= bbox.min_y && position.imag() <= bbox.max_y;
+    }
+public:
+    explicit SpatialGrid(precission cellSize = 64) : cellSize(cellSize) {
+    }
+
+    precission get_cell_size() const {
+        return cellSize;
+    }
+
+    /** change cell size, entries are moved to new cells */
+    void set_cell_size(precission size) {
+        std::vector<Entry> entries;
+        entries.reserve(count);
+        for (auto && cell : cells) {
+            entries.insert(entries.end(), cell.second.begin(), cell.second.end());
+        }
+        clear();
+        cellSize = size;
+        for (auto && entry : entries) {
+            set(entry.id, entry.position);
+        }
+    }
+
+    void clear() {
+        cells.clear();
+        locations.clear();
+        count = 0;
+    }
+
+    unsigned size() const {
+        return count;
+    }
+
+    /** insert or move entry \p id, positions which are not finite are removed from grid */
+    void set(unsigned id, const Complex & position) {
+        if (!std::isfinite(position.real()) || !std::isfinite(position.imag())) {
+            remove(id);
+            return;
+        }
+        if (id >= locations.size()) {
+            locations.resize(id + 1, Location{0, -1});
+        }
+        const uint64_t cell = cell_of(position);
+        Location & location = locations[id];
+        if (location.index >= 0) {
+            if (location.cell == cell) {
+                cells[cell][location.index].position = position;
+                return;
+            }
+            remove(id);
+        }
+        std::vector<Entry> & entries = cells[cell];
+        location.cell = cell;
+        location.index = entries.size();
+        entries.push_back(Entry{id, position});
+        count++;
+    }
+
+    void remove(unsigned id) {
+        if (id >= locations.size() || locations[id].index < 0) {
+            return;
+        }
+        Location & location = locations[id];
+        auto it = cells.find(location.cell);
+        std::vector<Entry> & entries = it->second;
+        // last entry of cell takes place of removed one
+        entries[location.index] = entries.back();
+        locations[entries[location.index].id].index = location.index;
+        entries.pop_back();
+        if (entries.empty()) {
+            cells.erase(it);
+        }
+        location.index = -1;
+        count--;
+    }
+
+    /** call \p visitor for every entry inside \p bbox (borders included) */
+    template<typename Visitor> void for_each_in_rect(const BBox & bbox, Visitor visitor) const {
+        const int64_t minX = cell_coord(bbox.min_x);
+        const int64_t minY = cell_coord(bbox.min_y);
+        const int64_t maxX = cell_coord(bbox.max_x);
+        const int64_t maxY = cell_coord(bbox.max_y);
+        const precission cellCount = static_cast<precission>(maxX - minX + 1) * (maxY - minY + 1);
+        if (cellCount > cells.size()) {
+            // large rectangle, faster to check all stored cells
+            for (auto && cell : cells) {
+                for (auto && entry : cell.second) {
+                    if (contains(bbox, entry.position)) {
+                        visitor(entry);
+                    }
+                }
+            }
+            return;
+        }
+        for (int64_t x = minX; x <= maxX; x++) {
+            for (int64_t y = minY; y <= maxY; y++) {
+                auto it = cells.find(cell_key(x, y));
+                if (it == cells.end()) {
+                    continue;
+                }
+                for (auto && entry : it->second) {
+                    if (contains(bbox, entry.position)) {
+                        visitor(entry);
+                    }
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,90 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using SymbolId = uint32_t;
+
+/**
+ * Stores each distinct string once, strings are identified by SymbolId.
+ * Symbol 0 is empty string.
+ */
+class StringInterner {
+private:
+    std::unordered_map<std::string, SymbolId> ids;
+    /** keys of ids, indexed by SymbolId, map nodes are not moved by rehash */
+    std::vector<const std::string *> strings;
+public:
+    StringInterner() {
+        clear();
+    }
+
+    /** copy keeps symbol ids, strings pointers are rebuilt for own map */
+    StringInterner(const StringInterner & other) {
+        *this = other;
+    }
+
+    StringInterner & operator=(const StringInterner & other) {
+        if (this != &other) {
+            ids.clear();
+            strings.clear();
+            for (auto && value : other.strings) {
+                intern(*value);
+            }
+        }
+        return *this;
+    }
+
+    void clear() {
+        ids.clear();
+        strings.clear();
+        intern("");
+    }
+
+    SymbolId intern(const std::string & value) {
+        auto it = ids.find(value);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        SymbolId id = strings.size();
+        strings.push_back(&ids.emplace(value, id).first->first);
+        return id;
+    }
+
+    /** find symbol without adding new string, @return false if \p value was never interned */
+    bool find(const std::string & value, SymbolId & id) const {
+        auto it = ids.find(value);
+        if (it == ids.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    const std::string & get(SymbolId id) const {
+        return *strings[id];
+    }
+
+    size_t size() const {
+        return strings.size();
+    }
+};
@@ -0,0 +1,171 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "ThreadPool.h"
+
+namespace {
+    /** true in worker threads and in thread running parallel_for, nested calls are serial */
+    thread_local bool insideJob = false;
+
+    /** marks calling thread as running job for its life time */
+    class InsideJob {
+    public:
+        InsideJob() {
+            insideJob = true;
+        }
+        InsideJob(const InsideJob &) = delete;
+        InsideJob & operator=(const InsideJob &) = delete;
+        ~InsideJob() {
+            insideJob = false;
+        }
+    };
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threadCount = hardware > 1 ? hardware - 1 : 0;
+    }
+    queues.reset(new TaskQueue[threadCount + 1]);
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto && worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool & ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::next_task(unsigned queue, unsigned & index) {
+    TaskQueue & own = queues[queue];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin != own.end) {
+            index = own.begin++;
+            return true;
+        }
+    }
+    const unsigned queueCount = concurrency();
+    for (unsigned offset = 1; offset < queueCount; offset++) {
+        TaskQueue & victim = queues[(queue + offset) % queueCount];
+        unsigned begin;
+        unsigned end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            unsigned remaining = victim.end - victim.begin;
+            if (remaining == 0) {
+                continue;
+            }
+            // victim keeps front half, its next tasks stay local
+            end = victim.end;
+            begin = end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+        index = begin;
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run_tasks(Job & current, unsigned queue) {
+    unsigned index;
+    while (next_task(queue, index)) {
+        if (!current.failed) {
+            try {
+                current.call(current.task, index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(current.errorMutex);
+                if (!current.error) {
+                    current.error = std::current_exception();
+                }
+                current.failed = true;
+            }
+        }
+        current.finished++;
+    }
+}
+
+void ThreadPool::worker_loop(unsigned queue) {
+    insideJob = true;
+    unsigned seenGeneration = 0;
+    while (true) {
+        Job * current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seenGeneration]() {
+                return stopping || (job != nullptr && jobGeneration != seenGeneration);
+            });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = jobGeneration;
+            current = job;
+            activeWorkers++;
+        }
+        run_tasks(*current, queue);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeWorkers--;
+        }
+        done.notify_all();
+    }
+}
+
+bool ThreadPool::can_run_parallel(unsigned count, std::unique_lock<std::mutex> & jobLock) {
+    return count >= 2 && !workers.empty() && !insideJob && jobLock.try_lock();
+}
+
+void ThreadPool::run_job(Job & current) {
+    // contiguous equal parts, neighbouring tasks usually touch neighbouring data
+    const unsigned queueCount = concurrency();
+    for (unsigned i = 0; i < queueCount; i++) {
+        std::lock_guard<std::mutex> lock(queues[i].mutex);
+        queues[i].begin = static_cast<unsigned long long>(current.count) * i / queueCount;
+        queues[i].end = static_cast<unsigned long long>(current.count) * (i + 1) / queueCount;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &current;
+        jobGeneration++;
+    }
+    wake.notify_all();
+    {
+        InsideJob inside;
+        run_tasks(current, 0);
+    }
+    // job stays visible until every task finished and no worker holds pointer to it
+    std::unique_lock<std::mutex> lock(mutex);
+    job = nullptr;
+    done.wait(lock, [this, &current]() {
+        return activeWorkers == 0 && current.finished == current.count;
+    });
+}
@@ -0,0 +1,123 @@
+/*
+    This file is part of libPerspective.
+    Copyright (C) 2020  Grzegorz Wójcik
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Pool of worker threads running one parallel_for job at a time.
+ * Every thread has its own deque of task indices, it takes tasks from front of own deque
+ * and idle thread steals back half of deque of busy one.
+ * Calls from worker threads or during running job are executed serially in calling thread.
+ */
+class ThreadPool {
+private:
+    /** range of task indices, owner takes from begin, thieves from end */
+    struct TaskQueue {
+        std::mutex mutex;
+        unsigned begin = 0;
+        unsigned end = 0;
+        /** keeps queues of different threads on different cache lines */
+        char padding[64];
+    };
+    struct Job {
+        void (*call)(void * task, unsigned index);
+        void * task;
+        unsigned count;
+        std::atomic<unsigned> finished;
+        /** set by first failed task, remaining tasks are skipped */
+        std::atomic<bool> failed;
+        /** first exception of task, rethrown by parallel_for */
+        std::exception_ptr error;
+        std::mutex errorMutex;
+    };
+    std::vector<std::thread> workers;
+    /** queue of calling thread first, then queues of workers */
+    std::unique_ptr<TaskQueue[]> queues;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    /** serializes jobs, parallel_for runs serially if pool is busy */
+    std::mutex jobMutex;
+    Job * job = nullptr;
+    unsigned jobGeneration = 0;
+    unsigned activeWorkers = 0;
+    bool stopping = false;
+
+    void worker_loop(unsigned queue);
+    /** take next task index of thread with deque \p queue, steal if it is empty */
+    bool next_task(unsigned queue, unsigned & index);
+    /** run tasks of \p current until all deques are empty, exception of task is stored in job */
+    void run_tasks(Job & current, unsigned queue);
+    /** true if pool can run job of \p count tasks in parallel now, \p jobLock is locked then */
+    bool can_run_parallel(unsigned count, std::unique_lock<std::mutex> & jobLock);
+    /** split tasks of \p current between deques and run them, calling thread takes part */
+    void run_job(Job & current);
+
+    template<typename Task>
+    static void call_task(void * task, unsigned index) {
+        (*static_cast<Task *>(task))(index);
+    }
+public:
+    /** \p threadCount workers, 0 - one less than hardware threads */
+    explicit ThreadPool(unsigned threadCount = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    /** shared pool used by graphs */
+    static ThreadPool & instance();
+
+    /** number of threads running tasks, including calling thread */
+    unsigned concurrency() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * call \p task for indices [0, \p count), returns when all calls finished, calling thread takes part,
+     * no allocation is made. If \p task throws, tasks not started yet are skipped and first exception
+     * is rethrown after all running tasks finished, like in serial loop.
+     */
+    template<typename Task>
+    void parallel_for(unsigned count, Task && task) {
+        std::unique_lock<std::mutex> jobLock(jobMutex, std::defer_lock);
+        if (!can_run_parallel(count, jobLock)) {
+            for (unsigned i = 0; i < count; i++) {
+                task(i);
+            }
+            return;
+        }
+        Job current;
+        current.call = &call_task<typename std::remove_reference<Task>::type>;
+        current.task = const_cast<void *>(static_cast<const void *>(&task));
+        current.count = count;
+        current.finished = 0;
+        current.failed = false;
+        run_job(current);
+        if (current.error) {
+            std::rethrow_exception(current.error);
+        }
+    }
+};
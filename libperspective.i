@@ -3,6 +3,7 @@
 %include <std_shared_ptr.i>
 %shared_ptr(PerspectiveLine)
 %shared_ptr(HorizonLineBase)
+%shared_ptr(RenderSnapshot)
 
 %{
 #include "Quaternion.h"
@@ -25,8 +26,34 @@
 %include "std_string.i"
 
 %ignore NodeVariant;
+%ignore PointTable;
+%ignore GraphBase::get_point_table;
+%ignore NodeWrapper::_children;
+%ignore NodeWrapper::_relations;
+%ignore NodeWrapper::_compute_additional_params;
+%ignore NodeWrapper::get_children;
+%ignore NodeWrapper::get_relations;
+
+%rename(get_children) NodeWrapper::get_children_list;
+%extend NodeWrapper {
+    std::vector<NodeWrapper*> get_children_list() {
+        return std::vector<NodeWrapper*>($self->get_children().begin(), $self->get_children().end());
+    }
+%pythoncode %{
+    name = property(lambda self: self.get_name(), lambda self, value: self.set_name(value))
+    compute_function_name = property(lambda self: self.get_compute_function_name())
+    enabled = property(lambda self: self.is_enabled(), lambda self, value: self.set_enabled(value))
+    locked = property(lambda self: self.is_locked(), lambda self, value: self.set_locked(value))
+%}
+}
 %ignore raw_data_to_python;
 %ignore python_to_raw_data;
+%ignore GraphBase::clone;
+%ignore NodeWrapper::clone_to;
+// python keeps name property, see %extend NodeWrapper
+%ignore NodeWrapper::name;
+%newobject PythonGraph::clone_graph;
+%rename(clone) PythonGraph::clone_graph;
 
 %include "Quaternion.h"
 %include "Point.h"
@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "../Graph.h"
+#include "graph_data.h"
+
+namespace {
+    std::atomic<size_t> allocationCount { 0 };
+}
+
+void * operator new(std::size_t size) {
+    allocationCount++;
+    void * ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t size) noexcept {
+    (void) size;
+    std::free(ptr);
+}
+
+TEST_CASE ( "Allocations" ) {
+    GraphBase graph;
+    RawGraph data = test_data::space_graph();
+    graph.initialize_from_structure(data);
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * forward = graph.get_by_tag("Forward");
+
+    SECTION ( "update point" ) {
+        graph.update(up, Complex(10, 10));
+        size_t before = allocationCount;
+        graph.update(up, Complex(20, 15));
+        size_t allocations = allocationCount - before;
+        REQUIRE(allocations == 0);
+    }
+    SECTION ( "parallel update" ) {
+        ThreadPool pool(3);
+        graph.set_thread_pool(pool);
+        graph.set_parallel_threshold(1);
+        graph.update(forward, Complex(10, 0));
+        size_t before = allocationCount;
+        graph.update(forward, Complex(25, 0));
+        size_t allocations = allocationCount - before;
+        REQUIRE(allocations == 0);
+    }
+    SECTION ( "update space" ) {
+        graph.update(forward, Complex(10, 0));
+        size_t before = allocationCount;
+        graph.update(forward, Complex(25, 0));
+        size_t allocations = allocationCount - before;
+        REQUIRE(allocations == 0);
+    }
+}
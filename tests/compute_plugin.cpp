@@ -0,0 +1,21 @@
+#include "../ComputePlugin.h"
+
+// compute plugin loaded by "compute registry" test, uses only C interface and does not link against library
+
+namespace {
+    void swap_xy(const ComputePluginArgs * args, ComputePluginDirection * dst) {
+        const ComputePluginDirection & src = args->src[0];
+        dst->x = src.y;
+        dst->y = src.x;
+        dst->z = src.z;
+        dst->w = src.w;
+    }
+}
+
+extern "C" int libperspective_register_compute_kernels(unsigned api_version, void * context, ComputePluginRegister register_kernel) {
+    if (api_version != LIBPERSPECTIVE_PLUGIN_API_VERSION) {
+        return 1;
+    }
+    ComputePluginKernel kernel = {"test_plugin_swap_xy", 1, 1, swap_xy};
+    return register_kernel(context, &kernel);
+}
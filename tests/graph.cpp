@@ -1,5 +1,29 @@
 #include <catch2/catch.hpp>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
 #include "../Graph.h"
+#include "graph_data.h"
+
+namespace {
+    void require_direction(NodeWrapper * node, const Quaternion & expected) {
+        Quaternion direction = normalize(node->as_vanishingPoint().get_direction());
+        Quaternion normalized = normalize(expected);
+        REQUIRE(direction.x == Approx(normalized.x).margin(1e-9));
+        REQUIRE(direction.y == Approx(normalized.y).margin(1e-9));
+        REQUIRE(direction.z == Approx(normalized.z).margin(1e-9));
+    }
+}
+
+/** graph loaded from test_data::space_graph, shared setup of graph test cases */
+struct SpaceGraphFixture {
+    GraphBase graph;
+    SpaceGraphFixture() {
+        RawGraph data = test_data::space_graph();
+        graph.initialize_from_structure(data);
+    }
+};
 
 TEST_CASE ( "Graph" ) {
     using namespace Catch::literals;
@@ -15,3 +39,1207 @@ TEST_CASE ( "Graph" ) {
         REQUIRE_THROWS_WITH(graph.create_from_structure(data), "bad structure - Graph");
     }
 }
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "compute program", "[graph]" ) {
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+    NodeWrapper * mirror2 = graph.get_by_tag("Mirror2");
+    NodeWrapper * side = graph.get_by_tag("Side");
+    NodeWrapper * measure = graph.get_by_tag("Measure");
+
+    ComputeProgram & program = graph.get_compute_program();
+    REQUIRE(program.get_instructions().size() == 3);
+    REQUIRE(mirror->_program_index < mirror2->_program_index);
+
+    require_direction(mirror, Quaternion(0.5, -1, 1));
+    require_direction(mirror2, Quaternion(0.5, 1, 1));
+    require_direction(measure, normalize(Quaternion(1, 0, 1)) - Quaternion(1, 0, 0));
+
+    SECTION ( "update chain" ) {
+        std::vector<NodeWrapper *> order;
+        for (auto && instruction : program.get_instructions()) {
+            order.push_back(instruction.dst);
+        }
+        graph.update(up, Complex(50, 50));
+        Quaternion upDirection = up->as_vanishingPoint().get_direction();
+        require_direction(mirror, Quaternion(upDirection.x, -upDirection.y, upDirection.z));
+        require_direction(mirror2, upDirection);
+        REQUIRE(mirror2->get_position().real() == Approx(50));
+        REQUIRE(mirror2->get_position().imag() == Approx(50));
+        // update does not change structure, program is not compiled again
+        REQUIRE(program.is_valid());
+        REQUIRE(program.get_instructions().size() == order.size());
+        for (unsigned i = 0; i < order.size(); i++) {
+            REQUIRE(program.get_instructions()[i].dst == order[i]);
+        }
+    }
+    SECTION ( "batch groups" ) {
+        auto && groups = program.get_groups();
+        REQUIRE(groups.size() == 3);
+        for (auto && instruction : program.get_instructions()) {
+            REQUIRE(ComputeProgram::is_batched(instruction));
+        }
+        // batch kernels give the same result as scalar compute functions
+        Quaternion batched = measure->as_vanishingPoint().get_direction();
+        precission param = 1;
+        ComputeArgs args = {
+            .src = &side,
+            .src_count = 1,
+            .params = &param,
+            .params_count = 1,
+            .kernel = nullptr,
+        };
+        measure->compute_measure_points(args);
+        require_direction(measure, batched);
+    }
+    SECTION ( "update space" ) {
+        NodeWrapper * forward = graph.get_by_tag("Forward");
+        graph.update(forward, Complex(30, 0));
+        Quaternion sideDirection = side->as_vanishingPoint().get_direction();
+        require_direction(measure, normalize(sideDirection) - Quaternion(1, 0, 0));
+    }
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "relations by type", "[graph]" ) {
+    NodeWrapper * view = graph.get_by_tag("View");
+    NodeWrapper * space = graph.get_by_tag("Space");
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * side = graph.get_by_tag("Side");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+
+    REQUIRE(up->get_parent() == space);
+    REQUIRE(up->get_view() == view);
+    REQUIRE(up->get_relations_of_type(NodeRelation::COMPUTE).size() == 1);
+    REQUIRE(up->get_relations_of_type(NodeRelation::COMPUTE).begin()->node == mirror);
+    REQUIRE(mirror->get_relations_of_type(NodeRelation::COMPUTE_SRC).size() == 1);
+    REQUIRE_THROWS(up->get_relations_of_type(NodeRelation::CHILD));
+
+    // relations added in any order stay grouped by type
+    mirror->add_relative(side, NodeRelation::COMPUTE_SRC);
+    mirror->set_parent(view);
+    REQUIRE(mirror->get_parent() == view);
+    REQUIRE(mirror->get_relations().front().relation == NodeRelation::PARENT);
+    REQUIRE(mirror->get_relations().back().node == side);
+    REQUIRE(mirror->get_relations_of_type(NodeRelation::PARENT).size() == 1);
+
+    mirror->clear_compute_sources();
+    REQUIRE(mirror->get_relations_of_type(NodeRelation::COMPUTE_SRC).empty());
+    REQUIRE(up->get_relations_of_type(NodeRelation::COMPUTE).empty());
+    REQUIRE(mirror->get_view() == view);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "relations changed after update", "[graph]" ) {
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * side = graph.get_by_tag("Side");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+    graph.update(up, Complex(50, 50));
+
+    // compute source replaced after program was compiled
+    mirror->clear_compute_sources();
+    side->add_relative(mirror, NodeRelation::COMPUTE);
+    mirror->add_relative(side, NodeRelation::COMPUTE_SRC);
+    graph.update(side, Complex(-40, 10));
+    Quaternion sideDirection = side->as_vanishingPoint().get_direction();
+    require_direction(mirror, Quaternion(sideDirection.x, -sideDirection.y, sideDirection.z));
+    Quaternion mirrorDirection = mirror->as_vanishingPoint().get_direction();
+    graph.update(up, Complex(20, 70));
+    require_direction(mirror, mirrorDirection);
+
+    // point moved to other parent is moved in tour
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    NodeWrapper * point = graph.add_sub_graph(pointData);
+    NodeWrapper * oldParent = point->get_parent();
+    NodeWrapper * space = graph.get_by_tag("Space");
+    oldParent->remove_child(point);
+    space->add_child(point);
+    point->set_parent(space);
+    auto contains = [this](NodeWrapper * root, NodeWrapper * node) {
+        GraphBase::NodeRange subtree = graph.get_subtree(root);
+        return std::find(subtree.begin(), subtree.end(), node) != subtree.end();
+    };
+    REQUIRE(contains(space, point));
+    REQUIRE(graph.get_subtree(space).size() == graph.get_all_nodes(space).size());
+    REQUIRE(graph.get_logic_children(space).back() == point);
+    REQUIRE(graph.get_subtree(oldParent).size() == graph.get_all_nodes(oldParent).size());
+}
+
+TEST_CASE ( "update_groups", "[graph]" ) {
+    RawGraph data = test_data::space_graph();
+    std::string parent = "Space";
+    for (int i = 0; i < 5000; i++) {
+        std::string id = "Nested" + std::to_string(i);
+        RawNode space = test_data::node("Space", id);
+        space.up = std::make_unique<Quaternion>(0, 1, 0);
+        test_data::add_child(data, std::move(space), parent);
+        parent = id;
+    }
+    RawNode deep = test_data::vp("Deep", Quaternion(1, 1, 1));
+    deep.tag = std::make_unique<std::string>("Deep");
+    test_data::add_child(data, std::move(deep), parent);
+
+    GraphBase graph;
+    graph.initialize_from_structure(data);
+    NodeWrapper * view = graph.get_by_tag("View");
+    NodeWrapper * space = graph.get_by_tag("Space");
+    NodeWrapper * deepNode = graph.get_by_tag("Deep");
+
+    REQUIRE(graph.get_logic_children(view).size() == 1);
+    REQUIRE(graph.get_logic_children(space).size() == 7);
+    REQUIRE(graph.update_groups(space).size() == 3);
+
+    // rotation of outer space reaches point nested 5000 spaces deep
+    Complex before = deepNode->get_position();
+    graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+    REQUIRE(deepNode->get_position().real() != Approx(before.real()));
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "subtree layout", "[graph]" ) {
+    NodeWrapper * space = graph.get_by_tag("Space");
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+
+    std::vector<int> added;
+    for (int i = 0; i < 20; i++) {
+        added.push_back(graph.add_sub_graph(pointData)->uid);
+    }
+    for (int i = 0; i < 20; i += 3) {
+        REQUIRE(graph.remove_by_uid(added[i]));
+    }
+    // every subtree is contiguous range starting with its root
+    for (auto && node : graph.get_subtree(graph.get_root())) {
+        GraphBase::NodeRange subtree = graph.get_subtree(node);
+        REQUIRE(*subtree.begin() == node);
+        size_t size = 1;
+        auto next = subtree.begin() + 1;
+        for (auto && child : node->get_children()) {
+            REQUIRE(*next == child);
+            size += graph.get_subtree(child).size();
+            next += graph.get_subtree(child).size();
+        }
+        REQUIRE(subtree.size() == size);
+    }
+    REQUIRE(graph.get_all_nodes(graph.get_root()).size() == 9 + 13);
+    REQUIRE(graph.get_points(space).size() == 6);
+
+    size_t enabled = graph.get_all_enabled_points().size();
+    space->toggle();
+    REQUIRE(graph.get_all_enabled_points().size() == enabled - 6);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "enabled points cache", "[graph]" ) {
+    NodeWrapper * space = graph.get_by_tag("Space");
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * side = graph.get_by_tag("Side");
+
+    const std::vector<NodeWrapper *> & enabled = graph.get_enabled_points();
+    const std::vector<NodeWrapper *> & unlocked = graph.get_enabled_points(true);
+    REQUIRE(enabled.size() == 6);
+    unsigned generation = graph.get_state_generation();
+    REQUIRE(&graph.get_enabled_points() == &enabled);
+    REQUIRE(graph.get_state_generation() == generation);
+
+    up->toggle();
+    REQUIRE(!up->is_enabled());
+    REQUIRE(graph.get_state_generation() != generation);
+    REQUIRE(enabled.size() == 5);
+    REQUIRE(std::find(enabled.begin(), enabled.end(), up) == enabled.end());
+
+    space->lock();
+    REQUIRE(space->is_locked());
+    REQUIRE(side->parent_locked);
+    REQUIRE(unlocked.empty());
+    REQUIRE(enabled.size() == 5);
+    space->toggle();
+    REQUIRE(!side->parent_enabled);
+    REQUIRE(enabled.empty());
+
+    space->set_enabled(true);
+    space->set_locked(false);
+    up->toggle();
+    REQUIRE(enabled.size() == 6);
+    REQUIRE(unlocked == enabled);
+    // incremental updates keep pre-order of full scan
+    graph.invalidate_point_cache();
+    REQUIRE(graph.get_enabled_points() == std::vector<NodeWrapper *>(enabled));
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "nodes_where", "[graph]" ) {
+    NodeWrapper * view = graph.get_by_tag("View");
+    NodeWrapper * space = graph.get_by_tag("Space");
+    NodeWrapper * up = graph.get_by_tag("Up");
+
+    const uint32_t enabledPoint = NODE_VISIBLE | NODE_UI | NODE_POINT;
+    REQUIRE(graph.nodes_where(enabledPoint, enabledPoint, view).size() == 6);
+    REQUIRE(graph.nodes_where(NODE_COMPUTE, NODE_COMPUTE).size() == 3);
+    REQUIRE(graph.nodes_where(NODE_SPACE, NODE_SPACE) == std::vector<NodeWrapper *>{space});
+
+    up->toggle();
+    REQUIRE(graph.nodes_where(enabledPoint, enabledPoint, view).size() == 5);
+    space->toggle();
+    REQUIRE(graph.nodes_where(enabledPoint, enabledPoint, view).empty());
+    REQUIRE(graph.nodes_where(NODE_POINT | NODE_PARENT_ENABLED, NODE_POINT, space).size() == 6);
+
+    up->set_compute(true);
+    REQUIRE(graph.nodes_where(NODE_COMPUTE, NODE_COMPUTE, space).size() == 4);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "point table", "[graph]" ) {
+    NodeWrapper * up = graph.get_by_tag("Up");
+
+    VanishingPoint & vp = up->as_vanishingPoint();
+    REQUIRE(&vp == &graph.get_point_table()[up->_slot]);
+    require_direction(up, Quaternion(0.5, 1, 1));
+
+    // references to point data stay valid when graph grows
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    for (unsigned i = 0; i < 3 * PointTable::CHUNK_SIZE; i++) {
+        graph.add_sub_graph(pointData);
+    }
+    REQUIRE(&up->as_vanishingPoint() == &vp);
+    REQUIRE(graph.get_point_table().chunk_count() == 4);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "interned names", "[graph]" ) {
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+    NodeWrapper * mirror2 = graph.get_by_tag("Mirror2");
+
+    REQUIRE(up->get_name() == "Up");
+    REQUIRE(&up->name() == &up->get_name());
+    REQUIRE(mirror->get_compute_function_name() == "compute_mirrored_points");
+    REQUIRE(up->get_compute_function_name().empty());
+    REQUIRE(graph.get_by_tag("Unknown") == nullptr);
+
+    size_t symbols = graph.get_memory_stats().symbols;
+    RawGraph pointData = test_data::point_graph("Up", Quaternion(1, 1, 1));
+    NodeWrapper * added = graph.add_sub_graph(pointData);
+    REQUIRE(added->_name == up->_name);
+    REQUIRE(graph.get_memory_stats().symbols == symbols);
+
+    mirror2->set_name("Mirror");
+    REQUIRE(mirror2->_name == mirror->_name);
+    REQUIRE(mirror2->get_name() == "Mirror");
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "batch update", "[graph]" ) {
+    static int computeCount = 0;
+    static bool computeThrows = false;
+    static ComputeKernelId countId = []() {
+        ComputeKernel kernel;
+        kernel.name = "test_count";
+        kernel.compute = [](NodeWrapper *, const ComputeArgs &) {
+            if (computeThrows) {
+                throw std::runtime_error("test compute error");
+            }
+            computeCount++;
+        };
+        return ComputeRegistry::instance().register_kernel(kernel);
+    }();
+    (void) countId;
+
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    std::vector<NodeWrapper *> points;
+    for (int i = 0; i < 10; i++) {
+        points.push_back(graph.add_sub_graph(pointData));
+    }
+    NodeWrapper * counter = graph.add_sub_graph(pointData);
+    graph.convert_to_compute_node(counter, points, "test_count", 0);
+
+    computeCount = 0;
+    for (int i = 0; i < 10; i++) {
+        graph.update(points[i], Complex(i, 10));
+    }
+    REQUIRE(computeCount == 10);
+
+    computeCount = 0;
+    {
+        GraphBatch batch(graph);
+        for (int i = 0; i < 10; i++) {
+            graph.update(points[i], Complex(10, i));
+        }
+        REQUIRE(computeCount == 0);
+    }
+    REQUIRE(computeCount == 1);
+    REQUIRE_FALSE(graph.is_in_batch());
+    REQUIRE_THROWS(graph.commit());
+
+    // batch left by exception is aborted without recompute
+    computeCount = 0;
+    try {
+        GraphBatch batch(graph);
+        graph.update(points[0], Complex(5, 5));
+        throw std::runtime_error("interrupted");
+    } catch (const std::runtime_error &) {
+    }
+    REQUIRE(computeCount == 0);
+    REQUIRE_FALSE(graph.is_in_batch());
+
+    // error of commit in destructor is logged, explicit commit throws it
+    computeThrows = true;
+    {
+        GraphBatch batch(graph);
+        graph.update(points[0], Complex(6, 6));
+    }
+    REQUIRE_FALSE(graph.is_in_batch());
+    {
+        GraphBatch batch(graph);
+        graph.update(points[0], Complex(7, 7));
+        REQUIRE_THROWS_WITH(batch.commit(), "test compute error");
+    }
+    computeThrows = false;
+    REQUIRE_FALSE(graph.is_in_batch());
+
+    graph.begin_batch();
+    REQUIRE_THROWS(graph.clear());
+    graph.commit();
+
+    // batch gives the same result as separate updates
+    GraphBase separate;
+    RawGraph separateData = test_data::space_graph();
+    separate.initialize_from_structure(separateData);
+    auto move = [](GraphBase & target) {
+        target.update(target.get_by_tag("Forward"), Complex(30, 0));
+        target.update(target.get_by_tag("Up"), Complex(40, 60));
+        target.update(target.get_by_tag("Forward"), Complex(20, 0));
+    };
+    move(separate);
+    graph.begin_batch();
+    move(graph);
+    graph.commit();
+    for (auto && tag : {"Up", "Side", "Mirror", "Mirror2", "Measure"}) {
+        require_direction(graph.get_by_tag(tag), separate.get_by_tag(tag)->as_vanishingPoint().get_direction());
+        REQUIRE(graph.get_by_tag(tag)->get_position().real() == Approx(separate.get_by_tag(tag)->get_position().real()));
+    }
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "change journal", "[graph]" ) {
+    REQUIRE(graph.get_changes().structure_changed);
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    NodeWrapper * point = graph.add_sub_graph(pointData);
+    REQUIRE(graph.get_changes().structure_changed);
+
+    Complex oldPosition = point->get_position();
+    graph.update(point, Complex(50, 60));
+    const ChangeSet & changes = graph.get_changes();
+    REQUIRE_FALSE(changes.structure_changed);
+    REQUIRE(changes.uids == std::vector<int>{point->uid});
+    REQUIRE(changes.old_bounds == std::vector<precission>{oldPosition.real(), oldPosition.imag(), oldPosition.real(), oldPosition.imag()});
+    REQUIRE(changes.new_bounds == std::vector<precission>{50, 60, 50, 60});
+
+    point->toggle();
+    REQUIRE(changes.uids == std::vector<int>{point->uid});
+    REQUIRE(changes.old_bounds == std::vector<precission>{50, 60, 50, 60});
+    REQUIRE(changes.new_bounds.empty());
+    point->toggle();
+
+    NodeWrapper * up = graph.get_by_tag("Up");
+    graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+    auto changed = [&changes](const NodeWrapper * node) {
+        return std::find(changes.uids.begin(), changes.uids.end(), node->uid) != changes.uids.end();
+    };
+    REQUIRE(changed(graph.get_by_tag("Space")));
+    REQUIRE(changed(up));
+    REQUIRE(changed(graph.get_by_tag("Measure")));
+    REQUIRE_FALSE(changed(point));
+    REQUIRE(changes.new_bounds.size() == 4);
+    REQUIRE(changes.new_bounds[0] <= up->get_position().real());
+    REQUIRE(changes.new_bounds[2] >= up->get_position().real());
+
+    {
+        GraphBatch batch(graph);
+        graph.update(point, Complex(10, 20));
+        graph.update(point, Complex(30, 40));
+    }
+    REQUIRE(changes.uids == std::vector<int>{point->uid});
+    REQUIRE(changes.old_bounds == std::vector<precission>{50, 60, 50, 60});
+    REQUIRE(changes.new_bounds == std::vector<precission>{30, 40, 30, 40});
+
+    REQUIRE(graph.remove_by_uid(point->uid));
+    REQUIRE(graph.get_changes().structure_changed);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "pick", "[graph]" ) {
+    graph.set_pick_cell_size(16);
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    std::vector<NodeWrapper *> added;
+    for (int i = 0; i < 50; i++) {
+        added.push_back(graph.add_sub_graph(pointData));
+        graph.update(added.back(), Complex((i * 37) % 200 - 100, (i * 53) % 200 - 100));
+    }
+    added[3]->toggle();
+    graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+
+    // enabled points are in pre-order, first of equally distant points wins
+    auto bruteForcePick = [this](Complex pos, precission radius) {
+        NodeWrapper * result = nullptr;
+        for (auto && point : graph.get_all_enabled_points()) {
+            precission distance = std::abs(point->get_position() - pos);
+            if (distance < radius || (distance == radius && result == nullptr)) {
+                result = point;
+                radius = distance;
+            }
+        }
+        return result;
+    };
+    for (int i = 0; i < 40; i++) {
+        Complex pos((i * 29) % 220 - 110, (i * 41) % 220 - 110);
+        REQUIRE(graph.pick(pos, 20) == bruteForcePick(pos, 20));
+    }
+    REQUIRE(graph.pick(added[3]->get_position(), 0.1) == nullptr);
+    REQUIRE(graph.pick(added[4]->get_position(), 0.1) == added[4]);
+
+    BBox bbox = {
+        .min_x = -50,
+        .min_y = -30,
+        .max_x = 40,
+        .max_y = 70,
+    };
+    std::vector<NodeWrapper *> inside;
+    for (auto && point : graph.get_all_enabled_points()) {
+        Complex pos = point->get_position();
+        if (pos.real() >= bbox.min_x && pos.real() <= bbox.max_x && pos.imag() >= bbox.min_y && pos.imag() <= bbox.max_y) {
+            inside.push_back(point);
+        }
+    }
+    REQUIRE(inside.size() > 0);
+    REQUIRE(graph.points_in_rect(bbox) == inside);
+
+    // pan moves points in grid, lazy view change projects points of view on next pick
+    NodeWrapper * view = graph.get_by_tag("View");
+    const Projection * projection = view->as_projection();
+    auto requirePickMatches = [&]() {
+        for (int i = 0; i < 40; i++) {
+            Complex pos((i * 29) % 220 - 110, (i * 41) % 220 - 110);
+            NodeWrapper * picked = graph.pick(pos, 20);
+            REQUIRE(picked == bruteForcePick(pos, 20));
+        }
+    };
+    graph.set_view_transform(view, projection->get_center_complex() + Complex(15, -5), projection->get_rotation(), projection->get_size());
+    requirePickMatches();
+    graph.set_view_transform(view, projection->get_center_complex(), projection->get_rotation() * std::polar(1.0, 0.2), projection->get_size() * 1.5);
+    graph.invalidate_view(view);
+    graph.set_view_transform(view, projection->get_center_complex() + Complex(-20, 10), projection->get_rotation(), projection->get_size());
+    requirePickMatches();
+
+    Complex removedPosition = added[4]->get_position();
+    REQUIRE(graph.remove_by_uid(added[4]->uid));
+    REQUIRE(graph.pick(removedPosition, 0.1) == nullptr);
+
+    // positions of points almost on horizon are finite but out of range of cell coords
+    SpatialGrid grid(16);
+    grid.set(1, Complex(1e300, -1e300));
+    grid.set(2, Complex(-1e300, 5));
+    grid.set(3, Complex(10, 10));
+    std::vector<unsigned> found;
+    grid.for_each_in_rect(BBox{.min_x = 1e299, .min_y = -2e300, .max_x = 2e300, .max_y = 0}, [&found](const SpatialGrid::Entry & entry) {
+        found.push_back(entry.id);
+    });
+    REQUIRE(found == std::vector<unsigned>{1});
+    grid.for_each_in_rect(BBox{.min_x = 0, .min_y = 0, .max_x = 20, .max_y = 20}, [&found](const SpatialGrid::Entry & entry) {
+        found.push_back(entry.id);
+    });
+    REQUIRE(found == std::vector<unsigned>{1, 3});
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "nearest directions", "[graph]" ) {
+    std::vector<NodeWrapper *> added;
+    for (int i = 0; i < 100; i++) {
+        Quaternion direction(std::sin(i * 0.7) * 3, std::cos(i * 1.3) * 2, ((i * 17) % 10) - 4.5);
+        RawGraph pointData = test_data::point_graph("Extra", direction);
+        added.push_back(graph.add_sub_graph(pointData));
+    }
+    added[5]->toggle();
+    graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+    graph.update(added[7], Complex(-20, 15));
+
+    uint32_t visibleVP = NODE_VISIBLE | NODE_VANISHING_POINT;
+    auto distance = [](NodeWrapper * node, const Quaternion & query) {
+        return length(normalize(node->as_vanishingPoint().get_direction()) - normalize(query));
+    };
+    // directions can repeat, so distances are compared instead of nodes
+    auto bruteForce = [this, &distance, visibleVP](const Quaternion & query, unsigned k) {
+        std::vector<precission> sorted;
+        for (auto && node : graph.nodes_where(visibleVP, visibleVP)) {
+            sorted.push_back(distance(node, query));
+        }
+        std::sort(sorted.begin(), sorted.end());
+        sorted.resize(std::min<size_t>(k, sorted.size()));
+        return sorted;
+    };
+    for (int i = 0; i < 30; i++) {
+        Quaternion query(std::cos(i * 0.9), std::sin(i * 2.1) * 2, std::cos(i * 0.4) - 0.3);
+        for (unsigned k : {1, 5}) {
+            std::vector<NodeWrapper *> nearest = graph.nearest_directions(query, k);
+            std::vector<precission> expected = bruteForce(query, k);
+            REQUIRE(nearest.size() == expected.size());
+            for (unsigned j = 0; j < k; j++) {
+                REQUIRE(distance(nearest[j], query) == Approx(expected[j]));
+            }
+        }
+    }
+    Quaternion moved = added[7]->as_vanishingPoint().get_direction();
+    REQUIRE(graph.nearest_directions(moved, 1).front() == added[7]);
+    REQUIRE(graph.nearest_directions(added[5]->as_vanishingPoint().get_direction(), 1).front() != added[5]);
+    REQUIRE(graph.nearest_directions(moved, 1000).size() == graph.nodes_where(visibleVP, visibleVP).size());
+}
+
+TEST_CASE ( "lazy reprojection", "[graph]" ) {
+    GraphBase lazy;
+    GraphBase eager;
+    RawGraph lazyData = test_data::space_graph();
+    RawGraph eagerData = test_data::space_graph();
+    lazy.initialize_from_structure(lazyData);
+    eager.initialize_from_structure(eagerData);
+    NodeWrapper * lazyView = lazy.get_by_tag("View");
+    NodeWrapper * eagerView = eager.get_by_tag("View");
+    NodeWrapper * up = lazy.get_by_tag("Up");
+    Complex before = up->get_position();
+
+    Complex center(40, -30);
+    Complex rotation = std::polar(1.0, 0.3);
+    lazyView->as_projection()->set_all(center, rotation, 700);
+    lazy.invalidate_view(lazyView);
+    eager.set_view_transform(eagerView, center, rotation, 700);
+    eager.update_groups(eagerView);
+    REQUIRE(lazy.get_changes().structure_changed);
+    // compute nodes reading only directions are not recomputed by view change
+    REQUIRE(lazy.is_position_outdated(lazy.get_by_tag("Mirror"), lazyView));
+    REQUIRE(lazy.is_position_outdated(lazy.get_by_tag("Measure"), lazyView));
+    // stored position is updated on first access
+    REQUIRE(up->as_vanishingPoint().get_position() == before);
+    REQUIRE(up->get_position() != before);
+
+    lazy.refresh_positions();
+    for (auto && tag : {"Up", "Side", "Forward", "Mirror", "Mirror2", "Measure"}) {
+        Complex lazyPosition = lazy.get_by_tag(tag)->as_vanishingPoint().get_position();
+        Complex eagerPosition = eager.get_by_tag(tag)->get_position();
+        REQUIRE(lazyPosition.real() == Approx(eagerPosition.real()));
+        REQUIRE(lazyPosition.imag() == Approx(eagerPosition.imag()));
+    }
+    REQUIRE(lazy.pick(up->get_position(), 0.1) == up);
+
+    // update after transform uses new view state
+    lazyView->as_projection()->set_all(center, rotation, 500);
+    lazy.invalidate_view(lazyView);
+    eager.set_view_transform(eagerView, center, rotation, 500);
+    eager.update_groups(eagerView);
+    lazy.update(lazy.get_by_tag("Forward"), Complex(30, 0));
+    eager.update(eager.get_by_tag("Forward"), Complex(30, 0));
+    for (auto && tag : {"Up", "Side", "Mirror", "Measure"}) {
+        REQUIRE(lazy.get_by_tag(tag)->get_position().real() == Approx(eager.get_by_tag(tag)->get_position().real()));
+        REQUIRE(lazy.get_by_tag(tag)->get_position().imag() == Approx(eager.get_by_tag(tag)->get_position().imag()));
+    }
+}
+
+TEST_CASE ( "view similarity transform", "[graph]" ) {
+    GraphBase fast;
+    GraphBase eager;
+    RawGraph fastData = test_data::space_graph();
+    RawGraph eagerData = test_data::space_graph();
+    fast.initialize_from_structure(fastData);
+    eager.initialize_from_structure(eagerData);
+    NodeWrapper * fastView = fast.get_by_tag("View");
+    NodeWrapper * eagerView = eager.get_by_tag("View");
+    // one point outdated before transform
+    fastView->as_projection()->set_size(300);
+    fast.invalidate_view(fastView);
+    eagerView->as_projection()->set_size(300);
+    eager.invalidate_view(eagerView);
+    eager.update_groups(eagerView);
+    fast.get_by_tag("Up")->get_position();
+
+    for (int i = 1; i < 4; i++) {
+        Complex center(10 * i, -25 * i);
+        Complex rotation = std::polar(1.0, 0.4 * i);
+        fast.set_view_transform(fastView, center, rotation, 100 + 50 * i);
+        eagerView->as_projection()->set_all(center, rotation, 100 + 50 * i);
+        eager.invalidate_view(eagerView);
+        eager.update_groups(eagerView);
+    }
+    // points moved by transform, not on access
+    Complex up = fast.get_by_tag("Up")->as_vanishingPoint().get_position();
+    REQUIRE(up.real() == Approx(eager.get_by_tag("Up")->get_position().real()));
+    REQUIRE(up.imag() == Approx(eager.get_by_tag("Up")->get_position().imag()));
+    for (auto && tag : {"Up", "Side", "Forward", "Mirror", "Mirror2", "Measure"}) {
+        Complex fastPosition = fast.get_by_tag(tag)->get_position();
+        Complex eagerPosition = eager.get_by_tag(tag)->get_position();
+        REQUIRE(fastPosition.real() == Approx(eagerPosition.real()));
+        REQUIRE(fastPosition.imag() == Approx(eagerPosition.imag()));
+    }
+}
+
+TEST_CASE ( "view change recomputes position dependent compute nodes", "[graph]" ) {
+    GraphBase graph;
+    RawGraph data = test_data::direction_2d_graph();
+    graph.initialize_from_structure(data);
+    NodeWrapper * view = graph.get_by_tag("View");
+    NodeWrapper * direction2d = graph.get_by_tag("Direction2d");
+    auto requireDirection2d = [&graph, direction2d]() {
+        Complex dir2d = graph.get_by_tag("Side")->get_position() - graph.get_by_tag("Up")->get_position();
+        Quaternion expected = normalize(Quaternion(dir2d.real(), dir2d.imag(), 0, 0));
+        Quaternion direction = direction2d->as_vanishingPoint().get_direction();
+        REQUIRE(direction.x == Approx(expected.x).margin(1e-9));
+        REQUIRE(direction.y == Approx(expected.y).margin(1e-9));
+        REQUIRE(direction.z == Approx(expected.z).margin(1e-9));
+    };
+    requireDirection2d();
+    Quaternion before = direction2d->as_vanishingPoint().get_direction();
+
+    graph.set_view_transform(view, Complex(40, -30), std::polar(1.0, 0.6), 700);
+    REQUIRE(length(direction2d->as_vanishingPoint().get_direction() - before) > 0.1);
+    requireDirection2d();
+
+    view->as_projection()->set_rotation(std::polar(1.0, -0.4));
+    graph.invalidate_view(view);
+    requireDirection2d();
+
+    // inside batch compute nodes wait for commit
+    graph.begin_batch();
+    graph.set_view_transform(view, Complex(0, 0), std::polar(1.0, 1.1), 500);
+    graph.commit();
+    requireDirection2d();
+}
+
+TEST_CASE ( "display transform", "[graph]" ) {
+    // mirror, scale and move
+    Affine2D display;
+    display.xx = -2;
+    display.xy = 0.5;
+    display.yy = 1.5;
+    display.x0 = 30;
+    display.y0 = -10;
+    auto requireEqual = [](const Complex & a, const Complex & b) {
+        REQUIRE(a.real() == Approx(b.real()));
+        REQUIRE(a.imag() == Approx(b.imag()));
+    };
+    Quaternion direction(0.3, -0.4, 1);
+    Complex start(20, 35);
+    Complex end(-40, 60);
+
+    RectilinearProjection rectilinear(Complex(-100, 0), Complex(100, 0));
+    RectilinearProjection rectilinearDisplay = rectilinear;
+    rectilinearDisplay.set_display_transform(display);
+    requireEqual(rectilinearDisplay.calc_pos_from_dir(direction), display.apply(rectilinear.calc_pos_from_dir(direction)));
+    Quaternion displayRay = rectilinearDisplay.calc_direction(display.apply(end));
+    Quaternion ray = rectilinear.calc_direction(end);
+    REQUIRE(displayRay.x == Approx(ray.x));
+    REQUIRE(displayRay.y == Approx(ray.y));
+    REQUIRE(displayRay.z == Approx(ray.z));
+    std::vector<Complex> points = rectilinear.get_line(direction, start)->get_line_points(end);
+    std::vector<Complex> displayPoints = rectilinearDisplay.get_line(direction, display.apply(start))->get_line_points(display.apply(end));
+    REQUIRE(displayPoints.size() == points.size());
+    // line end is projection of cursor on line, compare line direction
+    requireEqual(displayPoints[0], display.apply(points[0]));
+    Complex lineDirection = display.apply_linear(points[1] - points[0]);
+    Complex displayDirection = displayPoints[1] - displayPoints[0];
+    REQUIRE(std::abs(lineDirection.real() * displayDirection.imag() - lineDirection.imag() * displayDirection.real()) == Approx(0).margin(1e-6));
+    std::vector<Complex> horizon = rectilinear.get_horizon_line(Quaternion(0.2, 1, 0.3))->for_bbox(0, 0);
+    std::vector<Complex> displayHorizon = rectilinearDisplay.get_horizon_line(Quaternion(0.2, 1, 0.3))->for_bbox(0, 0);
+    for (unsigned i = 0; i < horizon.size(); i++) {
+        requireEqual(displayHorizon[i], display.apply(horizon[i]));
+    }
+
+    CurvilinearPerspective curvilinear(Complex(-100, 0), Complex(100, 0));
+    CurvilinearPerspective curvilinearDisplay = curvilinear;
+    curvilinearDisplay.set_display_transform(display);
+    requireEqual(curvilinearDisplay.calc_pos_from_dir(direction), display.apply(curvilinear.calc_pos_from_dir(direction)));
+    points = curvilinear.get_line(direction, start)->get_line_points(end);
+    displayPoints = curvilinearDisplay.get_line(direction, display.apply(start))->get_line_points(display.apply(end));
+    REQUIRE(displayPoints.size() == points.size());
+    for (unsigned i = 0; i < points.size(); i++) {
+        requireEqual(displayPoints[i], display.apply(points[i]));
+    }
+
+    struct SavedGraph : public GraphBase {
+        using GraphBase::to_raw_data;
+    };
+    SavedGraph graph;
+    RawGraph data = test_data::space_graph();
+    graph.initialize_from_structure(data);
+    NodeWrapper * up = graph.get_by_tag("Up");
+    Complex before = up->get_position();
+    graph.set_view_display_transform(graph.get_by_tag("View"), display);
+    requireEqual(up->get_position(), display.apply(before));
+    // similarity fast path keeps display transform
+    NodeWrapper * view = graph.get_by_tag("View");
+    graph.set_view_transform(view, Complex(5, 5), std::polar(1.0, 0.2), 150);
+    requireEqual(up->as_vanishingPoint().get_position(), view->as_projection()->calc_pos_from_dir(up->as_vanishingPoint().get_direction()));
+    graph.set_view_transform(view, Complex(0, 0), Complex(1, 0), 100);
+    // saved view is not affected by display transform
+    RawGraph saved = graph.to_raw_data();
+    for (auto && node : saved.nodes) {
+        if (node.type == "RectilinearProjection") {
+            requireEqual(*node.right, Complex(100, 0));
+        }
+    }
+    REQUIRE_THROWS(rectilinear.set_display_transform(Affine2D{0, 0, 0, 0, 0, 0}));
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "linked views", "[graph]" ) {
+    NodeWrapper * view = graph.get_by_tag("View");
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+    RawGraph thumbData;
+    thumbData.root = "Thumb";
+    RawNode thumbNode = test_data::node("CurvilinearPerspective", "Thumb");
+    thumbNode.left = std::make_unique<Complex>(300, 0);
+    thumbNode.right = std::make_unique<Complex>(400, 0);
+    thumbData.nodes.push_back(std::move(thumbNode));
+    NodeWrapper * thumb = graph.create_from_structure(thumbData);
+
+    REQUIRE_THROWS(graph.get_position_in_view(up, thumb));
+    graph.link_view(thumb, view);
+    REQUIRE(graph.get_linked_views(view) == std::vector<NodeWrapper *>{thumb});
+    auto expected = [thumb](NodeWrapper * node) {
+        return thumb->as_projection()->calc_pos_from_dir(node->as_vanishingPoint().get_direction());
+    };
+    REQUIRE(graph.get_position_in_view(up, thumb) == expected(up));
+    REQUIRE(graph.get_position_in_view(up, view) == up->get_position());
+
+    // direction change reaches cache of linked view
+    graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+    std::vector<Complex> positions = graph.get_positions_in_view({up, mirror}, thumb);
+    REQUIRE(positions[0] == expected(up));
+    REQUIRE(positions[1] == expected(mirror));
+
+    // direction changed outside of operation, without change journal
+    NodeWrapper * space = graph.get_by_tag("Space");
+    space->update_space(graph.get_by_tag("Forward")->as_vanishingPoint(), normalize(Quaternion(0.3, 0.1, 1)));
+    graph.update_groups(space);
+    REQUIRE(graph.get_position_in_view(up, thumb) == expected(up));
+    up->as_vanishingPoint().set_direction(normalize(Quaternion(0.2, 0.5, 1)));
+    REQUIRE(graph.get_position_in_view(up, thumb) == expected(up));
+
+    // transform of linked view does not touch main view
+    Complex mainPosition = up->as_vanishingPoint().get_position();
+    graph.set_view_transform(thumb, Complex(350, 20), Complex(0, 1), 80);
+    REQUIRE(up->as_vanishingPoint().get_position() == mainPosition);
+    REQUIRE(up->get_position() == mainPosition);
+    REQUIRE(graph.get_position_in_view(up, thumb) == expected(up));
+
+    graph.unlink_view(thumb);
+    REQUIRE(graph.get_linked_views(view).empty());
+    REQUIRE_THROWS(graph.get_position_in_view(up, thumb));
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "render snapshots", "[graph]" ) {
+    NodeWrapper * space = graph.get_by_tag("Space");
+    NodeWrapper * up = graph.get_by_tag("Up");
+    REQUIRE(graph.get_render_snapshot() == nullptr);
+
+    graph.set_publish_snapshots(true);
+    std::shared_ptr<const RenderSnapshot> first = graph.get_render_snapshot();
+    REQUIRE(first != nullptr);
+    auto indexOf = [](const RenderSnapshot & snapshot, int uid) {
+        return std::find(snapshot.uids.begin(), snapshot.uids.end(), uid) - snapshot.uids.begin();
+    };
+    size_t upIndex = indexOf(*first, up->uid);
+    REQUIRE(upIndex < first->uids.size());
+    REQUIRE(first->get_position(upIndex) == up->get_position());
+    REQUIRE(first->views[upIndex] == up->get_view()->uid);
+    REQUIRE(first->uids.size() == first->flags.size());
+
+    // held snapshot is not changed by later updates
+    Complex firstPosition = first->positions[upIndex];
+    graph.update(up, Complex(40, 60));
+    std::shared_ptr<const RenderSnapshot> second = graph.get_render_snapshot();
+    REQUIRE(second->generation == first->generation + 1);
+    REQUIRE(first->positions[upIndex] == firstPosition);
+    REQUIRE(second->get_position(upIndex) == up->get_position());
+
+    space->toggle();
+    std::shared_ptr<const RenderSnapshot> third = graph.get_render_snapshot();
+    REQUIRE((third->flags[upIndex] & NODE_VISIBLE) != NODE_VISIBLE);
+    REQUIRE((second->flags[upIndex] & NODE_VISIBLE) == NODE_VISIBLE);
+
+    // buffers of snapshot released by readers are reused
+    const RenderSnapshot * released = second.get();
+    second.reset();
+    graph.update(up, Complex(10, 60));
+    REQUIRE(graph.get_render_snapshot().get() == released);
+    first.reset();
+    third.reset();
+
+    // reader thread sees only complete snapshots
+    std::atomic<bool> running(true);
+    bool consistent = true;
+    std::thread reader([this, &running, &consistent]() {
+        unsigned generation = 0;
+        while (running) {
+            std::shared_ptr<const RenderSnapshot> snapshot = graph.get_render_snapshot();
+            const size_t count = snapshot->uids.size();
+            consistent &= snapshot->generation >= generation;
+            consistent &= snapshot->positions.size() == count && snapshot->directions.size() == count;
+            consistent &= snapshot->flags.size() == count && snapshot->views.size() == count;
+            consistent &= snapshot->outdated.size() == count;
+            generation = snapshot->generation;
+        }
+    });
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    for (int i = 0; i < 200; i++) {
+        graph.update(up, Complex(i, 60));
+        if (i % 20 == 0) {
+            graph.add_sub_graph(pointData);
+        }
+    }
+    running = false;
+    reader.join();
+    REQUIRE(consistent);
+    REQUIRE(graph.get_render_snapshot()->uids.size() == graph.nodes_where(NODE_VANISHING_POINT, NODE_VANISHING_POINT, graph.get_root()).size());
+
+    // view change does not reproject points of view, reader resolves outdated positions
+    NodeWrapper * view = graph.get_by_tag("View");
+    std::shared_ptr<const RenderSnapshot> beforeView = graph.get_render_snapshot();
+    upIndex = indexOf(*beforeView, up->uid);
+    Complex stored = up->as_vanishingPoint().get_position();
+    REQUIRE(beforeView->outdated[upIndex] == -1);
+    view->as_projection()->set_all(Complex(20, 10), std::polar(1.0, 0.5), 300);
+    graph.invalidate_view(view);
+    std::shared_ptr<const RenderSnapshot> afterView = graph.get_render_snapshot();
+    REQUIRE(up->as_vanishingPoint().get_position() == stored);
+    REQUIRE(afterView->outdated[upIndex] >= 0);
+    REQUIRE(afterView->projections.size() == 1);
+    view->as_projection()->set_size(800);
+    graph.invalidate_view(view);
+    Complex resolved = afterView->get_position(upIndex);
+    view->as_projection()->set_all(Complex(20, 10), std::polar(1.0, 0.5), 300);
+    graph.invalidate_view(view);
+    REQUIRE(resolved.real() == Approx(up->get_position().real()));
+    REQUIRE(resolved.imag() == Approx(up->get_position().imag()));
+    REQUIRE(beforeView->get_position(upIndex) == stored);
+    graph.update(up, Complex(5, 5));
+    REQUIRE(graph.get_render_snapshot()->get_position(upIndex) == up->get_position());
+}
+
+TEST_CASE ( "parallel documents", "[graph]" ) {
+    struct SavedGraph : public GraphBase {
+        using GraphBase::to_raw_data;
+    };
+    // load, edit and serialize one document, uids and printed directions depend only on document
+    auto process = [](int variant) {
+        SavedGraph graph;
+        RawGraph data = test_data::space_graph();
+        graph.initialize_from_structure(data);
+        RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, variant, 1));
+        for (int i = 0; i < variant; i++) {
+            graph.add_sub_graph(pointData);
+        }
+        graph.update(graph.get_by_tag("Up"), Complex(10 * variant, 50));
+        RawGraph saved = graph.to_raw_data();
+        std::string result = saved.root;
+        for (auto && node : saved.nodes) {
+            result += " " + node.id + ":" + node.type;
+            if (node.direction) {
+                result += node.direction->__str__();
+            }
+        }
+        return result;
+    };
+    const int variants = 5;
+    std::vector<std::string> expected;
+    for (int variant = 0; variant < variants; variant++) {
+        expected.push_back(process(variant));
+    }
+    REQUIRE(expected[0] != expected[1]);
+
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(8, 0);
+    for (unsigned t = 0; t < mismatches.size(); t++) {
+        threads.emplace_back([t, &process, &expected, &mismatches]() {
+            for (int document = 0; document < 40; document++) {
+                const int variant = (t + document) % variants;
+                mismatches[t] += process(variant) != expected[variant];
+            }
+        });
+    }
+    for (auto && thread : threads) {
+        thread.join();
+    }
+    REQUIRE(std::accumulate(mismatches.begin(), mismatches.end(), 0) == 0);
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "clone", "[graph]" ) {
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+    for (int i = 0; i < 600; i++) {
+        graph.add_sub_graph(pointData);
+    }
+    REQUIRE(graph.remove_by_uid(graph.add_sub_graph(pointData)->uid));
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * mirror = graph.get_by_tag("Mirror");
+    const Complex upPosition = up->get_position();
+    const Quaternion mirrorDirection = mirror->as_vanishingPoint().get_direction();
+
+    std::unique_ptr<GraphBase> preview = graph.clone();
+    NodeWrapper * previewUp = preview->get_by_tag("Up");
+    NodeWrapper * previewMirror = preview->get_by_tag("Mirror");
+    REQUIRE(previewUp != up);
+    REQUIRE(previewUp->uid == up->uid);
+    REQUIRE(previewUp->_graph == preview.get());
+    REQUIRE(previewUp->get_parent() == preview->get_by_tag("Space"));
+    REQUIRE(preview->get_all_nodes(preview->get_root()).size() == graph.get_all_nodes(graph.get_root()).size());
+    REQUIRE(preview->get_memory_stats().free_slots == graph.get_memory_stats().free_slots);
+    REQUIRE(preview->pick(upPosition, 1) == previewUp);
+
+    // point geometry is shared until written
+    const GraphBase & constGraph = graph;
+    const GraphBase & constPreview = *preview;
+    REQUIRE(graph.get_point_table().chunk_count() >= 3);
+    const unsigned farSlot = PointTable::CHUNK_SIZE + 1;
+    REQUIRE(&constPreview.get_point_table()[up->_slot] == &constGraph.get_point_table()[up->_slot]);
+
+    // edits of preview do not touch original graph
+    NodeWrapper * added = preview->add_sub_graph(pointData);
+    REQUIRE(graph.get_by_uid(added->uid) == nullptr);
+    preview->update(previewUp, Complex(40, 60));
+    REQUIRE(up->get_position() == upPosition);
+    REQUIRE(length(mirror->as_vanishingPoint().get_direction() - mirrorDirection) == 0);
+    REQUIRE(length(previewMirror->as_vanishingPoint().get_direction() - mirrorDirection) != 0);
+    REQUIRE(&constPreview.get_point_table()[up->_slot] != &constGraph.get_point_table()[up->_slot]);
+    REQUIRE(&constPreview.get_point_table()[farSlot] == &constGraph.get_point_table()[farSlot]);
+
+    // parallel update copies only chunks of points written by its tasks
+    ThreadPool pool(2);
+    preview->set_thread_pool(pool);
+    preview->set_parallel_threshold(1);
+    preview->update(preview->get_by_tag("Forward"), Complex(20, 30));
+    REQUIRE(length(previewMirror->as_vanishingPoint().get_direction() - mirrorDirection) != 0);
+    REQUIRE(&constPreview.get_point_table()[farSlot] == &constGraph.get_point_table()[farSlot]);
+
+    // edits of original graph do not touch preview
+    const Complex previewPosition = previewUp->get_position();
+    graph.update(up, Complex(10, 20));
+    REQUIRE(previewUp->get_position() == previewPosition);
+    REQUIRE(preview->remove_by_uid(previewUp->uid));
+    REQUIRE(graph.get_by_tag("Up") == up);
+
+    // original graph is still valid after preview is thrown away
+    preview.reset();
+    graph.update(up, Complex(30, 20));
+    REQUIRE(length(mirror->as_vanishingPoint().get_direction() - mirrorDirection) != 0);
+}
+
+TEST_CASE ( "thread pool", "[graph]" ) {
+    ThreadPool pool(3);
+    REQUIRE(pool.concurrency() == 4);
+    std::vector<int> values(1000, 0);
+    for (int run = 0; run < 20; run++) {
+        pool.parallel_for(values.size(), [&values, &pool](unsigned index) {
+            values[index]++;
+            // nested call runs serially
+            int nested = 0;
+            pool.parallel_for(3, [&nested](unsigned) {
+                nested++;
+            });
+            values[index] += nested - 3;
+        });
+    }
+    REQUIRE(std::all_of(values.begin(), values.end(), [](int value) {
+        return value == 20;
+    }));
+
+    // slow tasks at front, remaining tasks of busy thread are stolen
+    std::vector<std::atomic<int>> calls(37);
+    pool.parallel_for(calls.size(), [&calls](unsigned index) {
+        if (index < 3) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        calls[index]++;
+    });
+    REQUIRE(std::all_of(calls.begin(), calls.end(), [](const std::atomic<int> & value) {
+        return value == 1;
+    }));
+
+    // exception of task reaches caller, serial and parallel path behave the same
+    for (unsigned count : {1000u, 1u}) {
+        std::atomic<int> started(0);
+        REQUIRE_THROWS_WITH(pool.parallel_for(count, [&started, count](unsigned index) {
+            started++;
+            if (index == count / 2) {
+                throw std::runtime_error("task failed");
+            }
+        }), "task failed");
+        REQUIRE(started > 0);
+    }
+    // pool is still usable after failed job, calling thread is not left inside job
+    std::atomic<int> finished(0);
+    std::vector<std::thread::id> threads(200);
+    pool.parallel_for(threads.size(), [&finished, &threads](unsigned index) {
+        threads[index] = std::this_thread::get_id();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        finished++;
+    });
+    REQUIRE(finished == 200);
+    std::sort(threads.begin(), threads.end());
+    REQUIRE(std::unique(threads.begin(), threads.end()) - threads.begin() > 1);
+}
+
+TEST_CASE ( "parallel update_groups", "[graph]" ) {
+    auto blocks = []() {
+        RawGraph data = test_data::space_graph();
+        for (int i = 0; i < 40; i++) {
+            std::string id = "Block" + std::to_string(i);
+            RawNode space = test_data::node("Space", id);
+            space.up = std::make_unique<Quaternion>(0, 1, 0);
+            test_data::add_child(data, std::move(space), "Space");
+            for (int j = 0; j < 5; j++) {
+                test_data::add_child(data, test_data::vp(id + "VP" + std::to_string(j), Quaternion(j - 2, i % 3, 1)), id);
+            }
+            test_data::add_child(data, test_data::compute_vp(id + "Mirror", "compute_mirrored_points"), id);
+            test_data::add_compute_source(data, id + "Mirror", id + "VP0");
+            // unbatched compute function, computed on pool
+            test_data::add_child(data, test_data::compute_vp(id + "Direction2d", "2d_direction"), id);
+            test_data::add_compute_source(data, id + "Direction2d", id + "VP0");
+            test_data::add_compute_source(data, id + "Direction2d", id + "VP1");
+        }
+        return data;
+    };
+    GraphBase serial;
+    GraphBase parallel;
+    RawGraph serialData = blocks();
+    RawGraph parallelData = blocks();
+    serial.initialize_from_structure(serialData);
+    parallel.initialize_from_structure(parallelData);
+    ThreadPool pool(3);
+    parallel.set_thread_pool(pool);
+    parallel.set_parallel_threshold(1);
+
+    serial.update(serial.get_by_tag("Forward"), Complex(30, 10));
+    parallel.update(parallel.get_by_tag("Forward"), Complex(30, 10));
+
+    // graphs have the same layout, nodes are compared by position in pre-order
+    auto tourIndices = [](GraphBase & graph, const std::vector<int> & uids) {
+        std::vector<int> result;
+        for (auto && uid : uids) {
+            result.push_back(graph.get_by_uid(uid)->_tour_index);
+        }
+        return result;
+    };
+    REQUIRE(tourIndices(serial, serial.get_changes().uids) == tourIndices(parallel, parallel.get_changes().uids));
+    REQUIRE(serial.get_changes().new_bounds == parallel.get_changes().new_bounds);
+    std::vector<NodeWrapper *> serialNodes = serial.get_all_nodes(serial.get_root());
+    std::vector<NodeWrapper *> parallelNodes = parallel.get_all_nodes(parallel.get_root());
+    REQUIRE(serialNodes.size() == parallelNodes.size());
+    for (unsigned i = 0; i < serialNodes.size(); i++) {
+        if (serialNodes[i]->is_vanishing_point()) {
+            REQUIRE(serialNodes[i]->get_position() == parallelNodes[i]->get_position());
+            REQUIRE(length(serialNodes[i]->as_vanishingPoint().get_direction() - parallelNodes[i]->as_vanishingPoint().get_direction()) == 0);
+        }
+    }
+    std::vector<NodeWrapper *> serialCompute = serial.update_groups(serial.get_by_tag("Space"));
+    std::vector<NodeWrapper *> parallelCompute = parallel.update_groups(parallel.get_by_tag("Space"));
+    REQUIRE(serialCompute.size() == parallelCompute.size());
+    for (unsigned i = 0; i < serialCompute.size(); i++) {
+        REQUIRE(serialCompute[i]->_tour_index == parallelCompute[i]->_tour_index);
+    }
+
+    // clone shares point table chunks, parallel tasks of both graphs write to them at the same time
+    std::unique_ptr<GraphBase> cloned = parallel.clone();
+    ThreadPool clonePool(3);
+    cloned->set_thread_pool(clonePool);
+    cloned->set_parallel_threshold(1);
+    std::thread cloneThread([&cloned]() {
+        cloned->update(cloned->get_by_tag("Forward"), Complex(-20, 15));
+    });
+    parallel.update(parallel.get_by_tag("Forward"), Complex(-20, 15));
+    cloneThread.join();
+    serial.update(serial.get_by_tag("Forward"), Complex(-20, 15));
+    std::vector<NodeWrapper *> clonedNodes = cloned->get_all_nodes(cloned->get_root());
+    REQUIRE(clonedNodes.size() == serialNodes.size());
+    for (unsigned i = 0; i < serialNodes.size(); i++) {
+        if (serialNodes[i]->is_vanishing_point()) {
+            REQUIRE(serialNodes[i]->get_position() == parallelNodes[i]->get_position());
+            REQUIRE(serialNodes[i]->get_position() == clonedNodes[i]->get_position());
+        }
+    }
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "compute registry", "[graph]" ) {
+    ComputeRegistry & registry = ComputeRegistry::instance();
+    REQUIRE(registry.find("plane") != 0);
+    REQUIRE_THROWS_WITH(registry.find("test_unknown"), "unknown compute function");
+    REQUIRE_THROWS(registry.load_plugin("./missing_plugin.so"));
+
+    static ComputeKernelId negateId = [&registry]() {
+        ComputeKernel kernel;
+        kernel.name = "test_negate";
+        kernel.min_sources = 1;
+        kernel.max_sources = 1;
+        kernel.compute = [](NodeWrapper * dst, const ComputeArgs & args) {
+            Quaternion direction = args.src[0]->as_vanishingPoint().get_direction();
+            dst->as_vanishingPoint().set_direction(direction.scalar_mul(-1));
+        };
+        return registry.register_kernel(kernel);
+    }();
+    REQUIRE(registry.find("test_negate") == negateId);
+    REQUIRE_THROWS(registry.register_kernel(registry.get(negateId)));
+
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * side = graph.get_by_tag("Side");
+    NodeWrapper * measure = graph.get_by_tag("Measure");
+    measure->set_compute_fct_by_name("test_negate");
+    measure->update_compute_point_source(&graph, {up});
+    require_direction(measure, up->as_vanishingPoint().get_direction().scalar_mul(-1));
+
+    // second source is out of kernel arity, node is not computed and error is logged
+    Quaternion before = measure->as_vanishingPoint().get_direction();
+    measure->update_compute_point_source(&graph, {up, side});
+    graph.update(up, Complex(20, 20));
+    require_direction(measure, before);
+    REQUIRE(graph.get_compute_program().get_instructions()[measure->_program_index].kernel == nullptr);
+
+    // kernel of plugin is called like builtin one, plugin uses only C interface of ComputePlugin.h
+    static bool pluginLoaded = (registry.load_plugin(TEST_COMPUTE_PLUGIN), true);
+    REQUIRE(pluginLoaded);
+    // second load fails, its function is already registered
+    REQUIRE_THROWS(registry.load_plugin(TEST_COMPUTE_PLUGIN));
+    measure->set_compute_fct_by_name("test_plugin_swap_xy");
+    measure->update_compute_point_source(&graph, {side});
+    graph.update(side, Complex(35, 5));
+    Quaternion sideDirection = side->as_vanishingPoint().get_direction();
+    require_direction(measure, Quaternion(sideDirection.y, sideDirection.x, sideDirection.z, sideDirection.w));
+}
+
+TEST_CASE_METHOD ( SpaceGraphFixture, "remove_by_uid", "[graph]" ) {
+    NodeWrapper * up = graph.get_by_tag("Up");
+    NodeWrapper * space = graph.get_by_tag("Space");
+    RawGraph pointData = test_data::point_graph("Extra", Quaternion(1, 1, 1));
+
+    SECTION ( "memory stays flat" ) {
+        GraphMemoryStats before = graph.get_memory_stats();
+        bool removed = true;
+        for (int i = 0; i < 10000; i++) {
+            NodeWrapper * added = graph.add_sub_graph(pointData);
+            std::vector<NodeWrapper *> sources = {up};
+            graph.convert_to_compute_node(added, sources, "compute_mirrored_points", 0);
+            removed &= graph.remove_by_uid(added->uid);
+        }
+        REQUIRE(removed);
+        GraphMemoryStats after = graph.get_memory_stats();
+        REQUIRE(after.nodes == before.nodes);
+        REQUIRE(after.slots == before.slots + 1);
+        REQUIRE(after.relations == before.relations);
+        REQUIRE(after.children == before.children);
+        REQUIRE(after.uids == before.uids);
+    }
+    SECTION ( "subtree" ) {
+        GraphMemoryStats before = graph.get_memory_stats();
+        size_t reachable = graph.get_all_nodes(graph.get_root()).size();
+        const int spaceUid = space->uid;
+        REQUIRE(graph.remove_by_uid(spaceUid));
+        GraphMemoryStats after = graph.get_memory_stats();
+        REQUIRE(after.nodes == before.nodes - 7);
+        REQUIRE(after.free_slots == 7);
+        REQUIRE(graph.get_by_tag("Up") == nullptr);
+        REQUIRE(graph.get_all_nodes(graph.get_root()).size() == reachable - 7);
+        REQUIRE_FALSE(graph.remove_by_uid(spaceUid + 1000));
+        REQUIRE_FALSE(graph.remove_by_uid(graph.get_root()->uid));
+    }
+    SECTION ( "inside batch" ) {
+        // space rotated inside batch waits for commit
+        graph.begin_batch();
+        graph.update(graph.get_by_tag("Forward"), Complex(30, 0));
+        REQUIRE(graph.remove_by_uid(space->uid));
+        graph.commit();
+        REQUIRE(graph.get_by_tag("Forward") == nullptr);
+        REQUIRE_FALSE(graph.is_in_batch());
+    }
+}
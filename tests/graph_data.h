@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../RawData.h"
+
+namespace test_data {
+    inline RawNode node(const std::string & type, const std::string & id) {
+        RawNode result;
+        result.type = type;
+        result.id = id;
+        result.name = std::make_unique<std::string>(id);
+        return result;
+    }
+
+    inline RawNode vp(const std::string & id, const Quaternion & direction) {
+        RawNode result = node("VP", id);
+        result.direction = std::make_unique<Quaternion>(direction);
+        return result;
+    }
+
+    inline RawNode compute_vp(const std::string & id, const std::string & fct, precission param = 0) {
+        RawNode result = vp(id, Quaternion(0, 0, 1));
+        result.is_compute = std::make_unique<bool>(true);
+        result.compute_fct = std::make_unique<std::string>(fct);
+        result.compute_params = std::make_unique<std::vector<precission>>(1, param);
+        return result;
+    }
+
+    inline RawEdge edge(const std::string & src, const std::string & dst, const char * type = nullptr) {
+        RawEdge result;
+        result.src = src;
+        result.dst = dst;
+        if (type) {
+            result.type = std::make_unique<std::string>(type);
+        }
+        return result;
+    }
+
+    /** add \p node as child of \p parent, visible in view "View" */
+    inline void add_child(RawGraph & graph, RawNode node, const std::string & parent) {
+        std::string id = node.id;
+        graph.nodes.push_back(std::move(node));
+        graph.edges.push_back(edge(parent, id));
+        graph.edges.push_back(edge(id, "View", "VIEW"));
+    }
+
+    /** connect compute node \p dst with its source \p src */
+    inline void add_compute_source(RawGraph & graph, const std::string & dst, const std::string & src) {
+        graph.edges.push_back(edge(src, dst, "COMPUTE"));
+        graph.edges.push_back(edge(dst, src, "COMPUTE_SRC"));
+    }
+
+    /**
+     * Root -> View -> Space -> Forward, Side, Up
+     * Mirror = mirrored Up, Mirror2 = mirrored Mirror, Measure = measure point of Side
+     */
+    inline RawGraph space_graph() {
+        RawGraph graph;
+        graph.root = "Root";
+        graph.nodes.push_back(node("Group", "Root"));
+        RawNode view = node("RectilinearProjection", "View");
+        view.left = std::make_unique<Complex>(-100, 0);
+        view.right = std::make_unique<Complex>(100, 0);
+        graph.nodes.push_back(std::move(view));
+        graph.edges.push_back(edge("Root", "View"));
+
+        RawNode space = node("Space", "Space");
+        space.up = std::make_unique<Quaternion>(0, 1, 0);
+        add_child(graph, std::move(space), "View");
+
+        RawNode forward = vp("Forward", Quaternion(0, 0, 1));
+        forward.role = std::make_unique<std::string>("SPACE");
+        add_child(graph, std::move(forward), "Space");
+        add_child(graph, vp("Side", Quaternion(1, 0, 1)), "Space");
+        add_child(graph, vp("Up", Quaternion(0.5, 1, 1)), "Space");
+
+        add_child(graph, compute_vp("Mirror2", "compute_mirrored_points"), "Space");
+        add_child(graph, compute_vp("Mirror", "compute_mirrored_points"), "Space");
+        add_child(graph, compute_vp("Measure", "compute_measure_points", 1), "Space");
+        add_compute_source(graph, "Mirror", "Up");
+        add_compute_source(graph, "Mirror2", "Mirror");
+        add_compute_source(graph, "Measure", "Side");
+        for (auto && rawNode : graph.nodes) {
+            rawNode.tag = std::make_unique<std::string>(rawNode.id);
+        }
+        return graph;
+    }
+
+    /** space_graph with Direction2d = 2d_direction from positions of Up to Side */
+    inline RawGraph direction_2d_graph() {
+        RawGraph graph = space_graph();
+        RawNode direction2d = compute_vp("Direction2d", "2d_direction");
+        direction2d.tag = std::make_unique<std::string>("Direction2d");
+        add_child(graph, std::move(direction2d), "Space");
+        add_compute_source(graph, "Direction2d", "Up");
+        add_compute_source(graph, "Direction2d", "Side");
+        return graph;
+    }
+
+    /** single VP graph */
+    inline RawGraph point_graph(const std::string & id, const Quaternion & direction) {
+        RawGraph graph;
+        graph.root = id;
+        graph.nodes.push_back(vp(id, direction));
+        return graph;
+    }
+}
@@ -119,5 +119,20 @@ TEST_CASE ( "Graph python" ) {
         Py_DecRef(outData);
         Py_DecRef(locals);
         Py_DecRef(globals);
+
+        SECTION ("remove_by_uid") {
+            NodeWrapper * child = graph.get_root()->get_children()[0];
+            const int uid = child->uid;
+            const size_t count = rawOut.nodes.size();
+            REQUIRE(graph.remove_by_uid(uid) == true);
+            REQUIRE_FALSE(graph.remove_by_uid(uid));
+            PyObject * removedData = graph.to_object();
+            RawGraph rawRemoved = python_to_raw_data(removedData);
+            Py_DecRef(removedData);
+            REQUIRE(rawRemoved.nodes.size() < count);
+            for (auto && node : rawRemoved.nodes) {
+                REQUIRE(node.id != std::to_string(uid));
+            }
+        }
     }
 }
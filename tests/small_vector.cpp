@@ -0,0 +1,39 @@
+#include <catch2/catch.hpp>
+#include <vector>
+#include "../SmallVector.h"
+
+TEST_CASE ( "SmallVector" )
+{
+    SmallVector<int, 3> values;
+    SECTION ( "inline storage" ) {
+        values.push_back(1);
+        values.push_back(2);
+        values.push_back(3);
+        REQUIRE ( values.size() == 3 );
+        REQUIRE_FALSE ( values.is_allocated() );
+        values.push_back(4);
+        REQUIRE ( values.is_allocated() );
+        REQUIRE ( std::vector<int>(values.begin(), values.end()) == std::vector<int>{1, 2, 3, 4} );
+    }
+    SECTION ( "insert and erase" ) {
+        values = {1, 3, 5};
+        values.insert(values.begin() + 1, 2);
+        values.insert(values.end(), 6);
+        values.erase(values.begin() + 2);
+        REQUIRE ( std::vector<int>(values.begin(), values.end()) == std::vector<int>{1, 2, 5, 6} );
+        values.erase(values.begin(), values.begin() + 2);
+        REQUIRE ( std::vector<int>(values.rbegin(), values.rend()) == std::vector<int>{6, 5} );
+    }
+    SECTION ( "copy and move" ) {
+        values = {1, 2, 3, 4, 5};
+        SmallVector<int, 3> copy = values;
+        SmallVector<int, 3> moved = std::move(values);
+        REQUIRE ( values.empty() );
+        REQUIRE_FALSE ( values.is_allocated() );
+        REQUIRE ( std::vector<int>(copy.begin(), copy.end()) == std::vector<int>(moved.begin(), moved.end()) );
+        SmallVector<int, 3> small = {7};
+        moved = std::move(small);
+        REQUIRE ( moved.size() == 1 );
+        REQUIRE ( moved.front() == 7 );
+    }
+}